@@ -0,0 +1,49 @@
+#ifndef PGLOGICAL_COMPAT_PORT_ATOMICS_H
+#define PGLOGICAL_COMPAT_PORT_ATOMICS_H
+
+/*
+ * 9.4 has no atomics support, so emulate the few 64bit atomic operations
+ * pglogical uses with a spinlock.
+ */
+
+#include "storage/spin.h"
+
+typedef struct pg_atomic_uint64
+{
+	slock_t		mutex;
+	volatile uint64 value;
+} pg_atomic_uint64;
+
+static inline void
+pg_atomic_init_u64(volatile pg_atomic_uint64 *ptr, uint64 val)
+{
+	SpinLockInit(&ptr->mutex);
+	ptr->value = val;
+}
+
+static inline uint64
+pg_atomic_read_u64(volatile pg_atomic_uint64 *ptr)
+{
+	uint64		val;
+
+	SpinLockAcquire(&ptr->mutex);
+	val = ptr->value;
+	SpinLockRelease(&ptr->mutex);
+
+	return val;
+}
+
+static inline uint64
+pg_atomic_fetch_add_u64(volatile pg_atomic_uint64 *ptr, int64 add_)
+{
+	uint64		old;
+
+	SpinLockAcquire(&ptr->mutex);
+	old = ptr->value;
+	ptr->value = old + add_;
+	SpinLockRelease(&ptr->mutex);
+
+	return old;
+}
+
+#endif
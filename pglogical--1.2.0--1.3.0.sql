@@ -1,4 +1,6 @@
 ALTER TABLE pglogical.subscription ADD COLUMN sub_apply_delay interval NOT NULL DEFAULT '0';
+ALTER TABLE pglogical.subscription ADD COLUMN sub_coalesce_commits integer NOT NULL DEFAULT 0;
+ALTER TABLE pglogical.subscription ADD COLUMN sub_compression boolean NOT NULL DEFAULT false;
 
 CREATE TABLE pglogical.replication_set_seq (
     set_id oid NOT NULL,
@@ -20,6 +22,8 @@ ALTER TABLE pglogical.replication_set_relation RENAME TO replication_set_table;
 ALTER TABLE pglogical.replication_set_table
     ADD COLUMN set_att_filter text[],
     ADD COLUMN set_row_filter pg_node_tree;
+CREATE INDEX replication_set_table_reloid_idx
+    ON pglogical.replication_set_table (set_reloid);
 
 DROP FUNCTION pglogical.replication_set_add_table(set_name name, relation regclass, synchronize_data boolean);
 CREATE FUNCTION pglogical.replication_set_add_table(set_name name, relation regclass, synchronize_data boolean DEFAULT false, att_filter text[] DEFAULT NULL, row_filter text DEFAULT NULL)
@@ -35,7 +39,8 @@ DROP FUNCTION pglogical.create_subscription(subscription_name name, provider_dsn
     synchronize_data boolean, forward_origins text[]);
 CREATE FUNCTION pglogical.create_subscription(subscription_name name, provider_dsn text,
     replication_sets text[] = '{default,default_insert_only,ddl_sql}', synchronize_structure boolean = false,
-    synchronize_data boolean = true, forward_origins text[] = '{all}', apply_delay interval DEFAULT '0')
+    synchronize_data boolean = true, forward_origins text[] = '{all}', apply_delay interval DEFAULT '0',
+    coalesce_commits integer DEFAULT 0, compression boolean DEFAULT false)
 RETURNS oid STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_create_subscription';
 
 DROP VIEW pglogical.TABLES;
@@ -78,4 +83,9 @@ RETURNS record STRICT STABLE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_show_re
 CREATE FUNCTION pglogical.table_data_filtered(reltyp anyelement, relation regclass, repsets text[])
 RETURNS SETOF anyelement CALLED ON NULL INPUT STABLE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_table_data_filtered';
 
+CREATE FUNCTION pglogical.show_subscription_stats(subscription_name name DEFAULT NULL,
+    OUT subscription_name text, OUT exec_state_reuses bigint,
+    OUT exec_state_rebuilds bigint)
+RETURNS SETOF record STABLE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_show_subscription_stats';
+
 DROP INDEX local_node_onlyone;
@@ -29,7 +29,9 @@ CREATE TABLE pglogical.subscription (
     sub_slot_name name NOT NULL,
     sub_replication_sets text[],
     sub_forward_origins text[],
-    sub_apply_delay interval NOT NULL DEFAULT '0'
+    sub_apply_delay interval NOT NULL DEFAULT '0',
+    sub_coalesce_commits integer NOT NULL DEFAULT 0,
+    sub_compression boolean NOT NULL DEFAULT false
 );
 
 CREATE TABLE pglogical.local_sync_status (
@@ -54,7 +56,8 @@ RETURNS boolean STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_alte
 
 CREATE FUNCTION pglogical.create_subscription(subscription_name name, provider_dsn text,
     replication_sets text[] = '{default,default_insert_only,ddl_sql}', synchronize_structure boolean = false,
-    synchronize_data boolean = true, forward_origins text[] = '{all}', apply_delay interval DEFAULT '0')
+    synchronize_data boolean = true, forward_origins text[] = '{all}', apply_delay interval DEFAULT '0',
+    coalesce_commits integer DEFAULT 0, compression boolean DEFAULT false)
 RETURNS oid STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_create_subscription';
 CREATE FUNCTION pglogical.drop_subscription(subscription_name name, ifexists boolean DEFAULT false)
 RETURNS oid STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_drop_subscription';
@@ -78,6 +81,11 @@ CREATE FUNCTION pglogical.show_subscription_status(subscription_name name DEFAUL
     OUT forward_origins text[])
 RETURNS SETOF record STABLE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_show_subscription_status';
 
+CREATE FUNCTION pglogical.show_subscription_stats(subscription_name name DEFAULT NULL,
+    OUT subscription_name text, OUT exec_state_reuses bigint,
+    OUT exec_state_rebuilds bigint)
+RETURNS SETOF record STABLE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_show_subscription_stats';
+
 CREATE TABLE pglogical.replication_set (
     set_id oid NOT NULL PRIMARY KEY,
     set_nodeid oid NOT NULL,
@@ -96,6 +104,8 @@ CREATE TABLE pglogical.replication_set_table (
     set_row_filter pg_node_tree,
     PRIMARY KEY(set_id, set_reloid)
 ) WITH (user_catalog_table=true);
+CREATE INDEX replication_set_table_reloid_idx
+    ON pglogical.replication_set_table (set_reloid);
 
 CREATE TABLE pglogical.replication_set_seq (
     set_id oid NOT NULL,
@@ -64,6 +64,15 @@ static const struct config_enum_entry PGLogicalConflictResolvers[] = {
 };
 
 bool	pglogical_synchronous_commit = false;
+bool	pglogical_batch_inserts = true;
+int		pglogical_parallel_apply_workers = 0;
+bool	pglogical_pipelined_apply = false;
+int		pglogical_parallel_copy_streams = 1;
+int		pglogical_copy_chunk_size = 1048576;
+bool	pglogical_sync_defer_indexes = false;
+int		pglogical_sync_maintenance_work_mem = -1;
+int		pglogical_message_batch_size = 65536;
+bool	pglogical_compact_encoding = true;
 char   *pglogical_temp_directory;
 
 void _PG_init(void);
@@ -550,7 +559,8 @@ void
 pglogical_start_replication(PGconn *streamConn, const char *slot_name,
 							XLogRecPtr start_pos, const char *forward_origins,
 							const char *replication_sets,
-							const char *replicate_only_table)
+							const char *replicate_only_table,
+							bool compression)
 {
 	StringInfoData	command;
 	PGresult	   *res;
@@ -631,6 +641,20 @@ pglogical_start_replication(PGconn *streamConn, const char *slot_name,
 	/* Tell the upstream that we want unbounded metadata cache size */
 	appendStringInfoString(&command, ", \"relmeta_cache_size\" '-1'");
 
+	/* Small change messages can be sent in batches */
+	if (pglogical_message_batch_size > 0)
+		appendStringInfo(&command, ", \"message_batch_size\" '%d'",
+						 pglogical_message_batch_size);
+
+	/* Reference relations by small ids and use short field lengths */
+	if (pglogical_compact_encoding)
+		appendStringInfoString(&command, ", compact_encoding 'true'");
+
+#ifdef HAVE_LIBZ
+	if (compression)
+		appendStringInfoString(&command, ", compression 'zlib'");
+#endif
+
 	/* general info about the downstream */
 	appendStringInfo(&command, ", pg_version '%u'", PG_VERSION_NUM);
 	appendStringInfo(&command, ", pglogical_version '%s'", PGLOGICAL_VERSION);
@@ -797,6 +821,83 @@ _PG_init(void)
 							 0,
 							 NULL, NULL, NULL);
 
+	DefineCustomBoolVariable("pglogical.batch_inserts",
+							 "Batch consecutive inserts into same table during apply",
+							 NULL,
+							 &pglogical_batch_inserts,
+							 true, PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.message_batch_size",
+							"Number of bytes up to which the provider batches small change messages into one network message",
+							"Zero disables batching.",
+							&pglogical_message_batch_size,
+							65536, 0, 16 * 1024 * 1024,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pglogical.compact_encoding",
+							 "Ask the provider for the compact encoding of change messages",
+							 NULL,
+							 &pglogical_compact_encoding,
+							 true, PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.parallel_apply_workers",
+							"Number of helper workers used by each apply worker to apply transactions in parallel",
+							NULL,
+							&pglogical_parallel_apply_workers,
+							0, 0, PGLOGICAL_MAX_APPLY_HELPERS,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pglogical.pipelined_apply",
+							 "Apply changes in separate process from the one receiving them",
+							 NULL,
+							 &pglogical_pipelined_apply,
+							 false, PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.parallel_copy_streams",
+							"Number of tables copied concurrently during initial data synchronization",
+							NULL,
+							&pglogical_parallel_copy_streams,
+							1, 1, PGLOGICAL_MAX_COPY_STREAMS,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.copy_chunk_size",
+							"Size above which a table is copied in several chunks concurrently during initial data synchronization",
+							"Zero disables splitting of tables.",
+							&pglogical_copy_chunk_size,
+							1048576, 0, INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pglogical.sync_defer_indexes",
+							 "Build indexes after copying data when synchronizing individual tables",
+							 NULL,
+							 &pglogical_sync_defer_indexes,
+							 false, PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.sync_maintenance_work_mem",
+							"maintenance_work_mem used for building deferred indexes during table synchronization",
+							"-1 means the subscriber's own setting is used.",
+							&pglogical_sync_maintenance_work_mem,
+							-1, -1, MAX_KILOBYTES,
+							PGC_SIGHUP,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
 	/*
 	 * We can't use the temp_tablespace safely for our dumps, because Pg's
 	 * crash recovery is very careful to delete only particularly formatted
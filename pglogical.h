@@ -38,7 +38,19 @@
 
 #define REPLICATION_ORIGIN_ALL "all"
 
+#define PGLOGICAL_MAX_APPLY_HELPERS 64
+#define PGLOGICAL_MAX_COPY_STREAMS 64
+
 extern bool pglogical_synchronous_commit;
+extern bool pglogical_batch_inserts;
+extern int pglogical_parallel_apply_workers;
+extern bool pglogical_pipelined_apply;
+extern int pglogical_parallel_copy_streams;
+extern int pglogical_copy_chunk_size;
+extern bool pglogical_sync_defer_indexes;
+extern int pglogical_sync_maintenance_work_mem;
+extern int pglogical_message_batch_size;
+extern bool pglogical_compact_encoding;
 extern char *pglogical_temp_directory;
 extern char *pglogical_extra_connection_options;
 
@@ -69,7 +81,8 @@ extern void pglogical_start_replication(PGconn *streamConn,
 										XLogRecPtr start_pos,
 										const char *forward_origins,
 										const char *replication_sets,
-										const char *replicate_only_table);
+										const char *replicate_only_table,
+										bool compression);
 
 extern void pglogical_manage_extension(void);
 
@@ -12,14 +12,21 @@
  */
 #include "postgres.h"
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #include "miscadmin.h"
 #include "libpq-fe.h"
 #include "pgstat.h"
 
+#include "access/genam.h"
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 
 #include "catalog/namespace.h"
+#include "catalog/pg_type.h"
 
 #include "commands/dbcommands.h"
 #include "commands/sequence.h"
@@ -41,18 +48,25 @@
 
 #include "rewrite/rewriteHandler.h"
 
+#include "storage/dsm.h"
 #include "storage/ipc.h"
 #include "storage/lmgr.h"
 #include "storage/proc.h"
+#include "storage/procarray.h"
+#include "storage/shm_mq.h"
+#include "storage/spin.h"
 
 #include "tcop/pquery.h"
 #include "tcop/utility.h"
 
 #include "utils/builtins.h"
 #include "utils/int8.h"
+#include "utils/inval.h"
 #include "utils/jsonb.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
 #include "utils/snapmgr.h"
 
 #include "pglogical_conflict.h"
@@ -68,16 +82,62 @@
 
 
 void pglogical_apply_main(Datum main_arg);
+void pglogical_apply_helper_main(Datum main_arg);
 
 static bool			in_remote_transaction = false;
 static XLogRecPtr	remote_origin_lsn = InvalidXLogRecPtr;
 static RepOriginId	remote_origin_id = InvalidRepOriginId;
 static TimeOffset	apply_delay = 0;
 
+/*
+ * Commit coalescing.
+ *
+ * When the subscription has coalesce_commits set, the apply worker doesn't
+ * commit every remote transaction separately, instead it keeps the local
+ * transaction open and applies the following remote transactions in it too.
+ * The local transaction is committed once it contains coalesce_commits remote
+ * transactions, once it's been open for COALESCE_MAX_DELAY_MS or as soon as
+ * there is no more data immediately available from the provider. The commit
+ * record carries origin lsn and timestamp of the last included remote commit
+ * so the replication origin progress stays correct.
+ */
+#define COALESCE_MAX_DELAY_MS	100
+
+static int			coalesce_commits = 0;
+static int			CoalescedCommits = 0;	/* Remote commits not yet
+											 * committed locally. */
+static TimestampTz	CoalesceStart = 0;
+static XLogRecPtr	CoalescedCommitLsn = InvalidXLogRecPtr;
+static TimestampTz	CoalescedCommitTime = 0;
+static XLogRecPtr	CoalescedEndLsn = InvalidXLogRecPtr;
+static bool			CoalesceBreak = false;	/* Current remote transaction
+											 * can't be coalesced. */
+
 static Oid			QueueRelid = InvalidOid;
 
+#ifdef HAVE_LIBZ
+/* Decompression state of the replication stream. */
+static z_stream	   *StreamInflate = NULL;
+#endif
+
 static List		   *SyncingTables = NIL;
 
+/*
+ * Set of the tables in SyncingTables for fast lookups during apply.
+ *
+ * SyncingTablesVersion is incremented on every change so that the per
+ * relation flag cached in PGLogicalRelation can be checked cheaply.
+ */
+typedef struct SyncingTableEntry
+{
+	NameData	nspname;		/* Hash key, must be first. */
+	NameData	relname;
+	int			refcount;
+} SyncingTableEntry;
+
+static HTAB		   *SyncingTablesHash = NULL;
+static uint32		SyncingTablesVersion = 1;
+
 PGLogicalApplyWorker	   *MyApplyWorker = NULL;
 PGLogicalSubscription	   *MySubscription = NULL;
 
@@ -92,29 +152,306 @@ typedef struct PGLFlushPosition
 
 dlist_head lsn_mapping = DLIST_STATIC_INIT(lsn_mapping);
 
+/*
+ * Executor state used for applying changes to a local relation.
+ *
+ * The state is attached to the PGLogicalRelation and reused by consecutive
+ * changes to the same relation within the local transaction. It is released
+ * at the end of the transaction, before processing queued messages (which can
+ * run DDL) and whenever the relation gets invalidated.
+ */
 typedef struct ApplyExecState {
+	dlist_node			node;			/* Entry in ApplyExecStates. */
+	PGLogicalRelation  *pglrel;			/* Relation cache entry we belong to. */
+	Oid					reloid;
+	Relation			rel;			/* Our own reference to the relation. */
+	bool				stale;			/* Relation was invalidated. */
+	uint32				map_version;	/* Mapping the state was built for. */
+
 	EState			   *estate;
 	EPQState		   epqstate;
 	ResultRelInfo	   *resultRelInfo;
 	TupleTableSlot	   *slot;
+	TupleTableSlot	   *remoteslot;		/* Original slot, triggers may
+										 * replace the slot above. */
+	TupleTableSlot	   *localslot;
+
+	/* Defaults for missing columns, see fill_missing_defaults(). */
+	int					ndefaults;
+	int				   *defmap;
+	ExprState		  **defexprs;
+
+	bool				batchable;		/* Can inserts be batched? */
 } ApplyExecState;
 
+/*
+ * Maximum number of executor states kept open at the same time, each one
+ * holds open the relation and all its indexes.
+ */
+#define MAX_CACHED_EXEC_STATES	32
+
+/* Cached executor states, most recently used first. */
+static dlist_head	ApplyExecStates = DLIST_STATIC_INIT(ApplyExecStates);
+static int			NumApplyExecStates = 0;
+
+/*
+ * Inserts waiting to be written using heap_multi_insert(), see
+ * handle_insert(). The limits are the same as what COPY uses.
+ */
+#define MAX_BATCH_INSERT_TUPLES	1000
+#define MAX_BATCH_INSERT_BYTES	65535
+
+typedef struct ApplyInsertBatch {
+	ApplyExecState	   *aestate;		/* State of the target relation. */
+	MemoryContext		context;		/* Memory for buffered tuples. */
+	int					ntuples;
+	Size				nbytes;
+	HeapTuple			tuples[MAX_BATCH_INSERT_TUPLES];
+} ApplyInsertBatch;
+
+static ApplyInsertBatch *InsertBatch = NULL;
+
+/*
+ * Parallel apply.
+ *
+ * When pglogical.parallel_apply_workers is set, the apply worker (leader)
+ * only receives the stream and buffers every remote transaction until its
+ * COMMIT arrives. The whole transaction is then sent over shm_mq to one of
+ * the helper workers. If the transaction touches relation which is also
+ * touched by a transaction still being applied by another helper, we wait
+ * for that one to finish first. Helpers commit in the order in which the
+ * transactions were dispatched, so the progress of the replication origin
+ * (which is advanced by every commit) is always consistent.
+ *
+ * Transactions which can't be applied in parallel (queued messages, tables
+ * being synchronized, very big transactions) are applied by the leader
+ * itself once all the helpers are idle.
+ *
+ * In the pipelined mode (pglogical.pipelined_apply) there is only one helper
+ * and the leader passes every message to it as soon as it's received,
+ * without buffering whole transactions. The leader keeps reading the stream
+ * and sending feedback while the helper applies the changes.
+ */
+typedef struct ParallelApplyHelper {
+	PGPROC		   *proc;			/* Helper process. */
+	int				slot;			/* Worker slot of the helper. */
+	uint16			generation;
+	uint64			seqno;			/* Assigned transaction. */
+	TransactionId	xid;			/* Local xid of the transaction. */
+	XLogRecPtr		commit_lsn;		/* Remote commit lsn. */
+	XLogRecPtr		remote_end;		/* End of the committed transaction. */
+	XLogRecPtr		local_end;		/* End of our commit record. */
+} ParallelApplyHelper;
+
+typedef struct ParallelApplyShared {
+	slock_t			mutex;
+	PGPROC		   *leader;
+	int				leader_slot;	/* Worker slot of the leader. */
+	uint16			leader_generation;
+	bool			leader_exited;	/* Leader is gone or going away. */
+	uint64			next_commit;	/* Transaction which commits next. */
+	bool			pipelined;		/* Single helper applying everything. */
+	Size			queue_size;		/* Size of each helper queue. */
+	int				nhelpers;
+	ParallelApplyHelper helpers[FLEXIBLE_ARRAY_MEMBER];
+	/* Followed by shm_mq for every helper. */
+} ParallelApplyShared;
+
+#define PARALLEL_APPLY_QUEUE_SIZE		(256 * 1024)
+/* The pipelined helper gets all the messages so give it more space. */
+#define PIPELINED_APPLY_QUEUE_SIZE		(8 * 1024 * 1024)
+/* Bigger transactions are applied by the leader. */
+#define PARALLEL_APPLY_MAX_TXN_SIZE		(16 * 1024 * 1024)
+
+/* Leader's info about helper. */
+typedef struct ParallelApplyHelperInfo {
+	int				slot;			/* Worker slot of the helper. */
+	uint16			generation;
+	shm_mq_handle  *mqh;
+	uint64			seqno;			/* Dispatched transaction, 0 if idle. */
+} ParallelApplyHelperInfo;
+
+/*
+ * Number of slots the key hashes of a relation are folded into, collisions
+ * only make transactions wait for each other needlessly.
+ */
+#define PARALLEL_APPLY_KEY_SLOTS		1024
+
+struct PendingRelation;
+
+/* Last RELATION message for a remote relation. */
+typedef struct ParallelApplyRelation {
+	uint32			remoteid;		/* Hash key. */
+	uint32			version;
+	StringInfo		msg;
+	uint32			sent_version[PGLOGICAL_MAX_APPLY_HELPERS];
+	uint64			last_seqno;		/* Last transaction touching it. */
+	uint64			last_txn;		/* Last buffered transaction touching it. */
+	struct PendingRelation *pending;	/* Valid if last_txn is current. */
+
+	/*
+	 * Rows are told apart by the replica identity if keyattlens is set, see
+	 * parallel_apply_relation_keys.
+	 */
+	int				natts;
+	int16		   *keyattlens;
+	uint64		   *key_seqno;		/* Last transaction per key slot. */
+	uint64			last_rel_seqno;	/* Last one not tracked by key. */
+} ParallelApplyRelation;
+
+/* Relation touched by the buffered transaction. */
+typedef struct PendingRelation {
+	ParallelApplyRelation *entry;
+	uint32			version;		/* Version at the time of first change. */
+	StringInfo		msg;
+	bool			whole;			/* Some change not tracked by key. */
+	Bitmapset	   *keyslots;		/* Key slots of the other changes. */
+} PendingRelation;
+
+static ParallelApplyShared *ParallelApply = NULL;
+static int			MyApplyHelperId = -1;
+
+/* Only hold the replication origin session while committing. */
+static bool			ApplyOriginShared = false;
+
+/* Leader only. */
+static ParallelApplyHelperInfo *ApplyHelpers = NULL;
+static HTAB		   *ParallelApplyRelations = NULL;
+static MemoryContext ParallelTxnContext = NULL;
+static uint64		LastDispatched = 0;
+static uint64		LastCollected = 0;
+static uint64		PendingTxn = 0;
+static List		   *PendingMsgs = NIL;
+static List		   *PendingRelations = NIL;
+static List		   *PendingRedefined = NIL;
+static Size			PendingSize = 0;
+static bool			PendingSerial = false;
+static uint64		PendingDependsOn = 0;
+static XLogRecPtr	PendingCommitLsn = InvalidXLogRecPtr;
+static bool			ApplyingLocally = false;
+
+static void free_apply_exec_state(ApplyExecState *aestate);
+static void release_apply_exec_states(void);
+static void flush_insert_batch(void);
+static void parallel_apply_helper_xid(TransactionId xid);
+static void parallel_apply_leader_exit(int code, Datum arg);
+static void parallel_apply_wait_for_turn(void);
+static void parallel_apply_helper_done(XLogRecPtr local_end,
+									   XLogRecPtr remote_end,
+									   XLogRecPtr commit_lsn);
+static void flush_coalesced_commits(void);
+static void reread_unsynced_tables(Oid subid);
 static void handle_queued_message(HeapTuple msgtup, bool tx_just_started);
 static void handle_startup_param(const char *key, const char *value);
 static bool parse_bool_param(const char *key, const char *value);
 static void process_syncing_tables(XLogRecPtr end_lsn);
 static void start_sync_worker(RangeVar *rv);
+static void apply_payload(StringInfo s);
+
+static void
+syncing_table_key(SyncingTableEntry *key, const char *nspname,
+				  const char *relname)
+{
+	memset(key, 0, sizeof(SyncingTableEntry));
+	namestrcpy(&key->nspname, nspname);
+	namestrcpy(&key->relname, relname);
+}
+
+/*
+ * Add table to the list of tables being synchronized.
+ */
+static void
+syncing_tables_add(const char *nspname, const char *relname)
+{
+	SyncingTableEntry	key;
+	SyncingTableEntry  *entry;
+	MemoryContext		oldcontext;
+	bool				found;
+
+	if (SyncingTablesHash == NULL)
+	{
+		HASHCTL		ctl;
+		int			hash_flags = HASH_ELEM | HASH_CONTEXT;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = offsetof(SyncingTableEntry, refcount);
+		ctl.entrysize = sizeof(SyncingTableEntry);
+		ctl.hcxt = TopMemoryContext;
+#if PG_VERSION_NUM >= 90500
+		hash_flags |= HASH_BLOBS;
+#else
+		ctl.hash = tag_hash;
+		hash_flags |= HASH_FUNCTION;
+#endif
+		SyncingTablesHash = hash_create("pglogical syncing tables", 128,
+										&ctl, hash_flags);
+	}
+
+	syncing_table_key(&key, nspname, relname);
+	entry = hash_search(SyncingTablesHash, (void *) &key, HASH_ENTER, &found);
+	if (!found)
+		entry->refcount = 0;
+	entry->refcount++;
+
+	/* Keep the lists persistent. */
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	SyncingTables = lappend(SyncingTables,
+							makeRangeVar(pstrdup(nspname), pstrdup(relname),
+										 -1));
+	MemoryContextSwitchTo(oldcontext);
+
+	SyncingTablesVersion++;
+}
+
+/*
+ * Forget the table from the set of tables being synchronized, the caller is
+ * responsible for removing it from the SyncingTables list.
+ */
+static void
+syncing_tables_forget(RangeVar *rv)
+{
+	SyncingTableEntry	key;
+	SyncingTableEntry  *entry;
+
+	syncing_table_key(&key, rv->schemaname, rv->relname);
+	entry = hash_search(SyncingTablesHash, (void *) &key, HASH_FIND, NULL);
+	if (entry && --entry->refcount <= 0)
+		hash_search(SyncingTablesHash, (void *) &key, HASH_REMOVE, NULL);
+
+	SyncingTablesVersion++;
+}
 
 /*
  * Check if given relation is in process of being synchronized.
- *
- * TODO: performance
  */
 static bool
 check_syncing_relation(const char *nspname, const char *relname)
 {
-	return list_length(SyncingTables) &&
-		list_member(SyncingTables, makeRangeVar((char *)nspname, (char *)relname, -1));
+	SyncingTableEntry	key;
+
+	if (list_length(SyncingTables) == 0)
+		return false;
+
+	syncing_table_key(&key, nspname, relname);
+
+	return hash_search(SyncingTablesHash, (void *) &key, HASH_FIND,
+					   NULL) != NULL;
+}
+
+/*
+ * Same as check_syncing_relation(), but the result is cached in the relation
+ * entry until the set of tables being synchronized changes.
+ */
+static bool
+check_syncing_remote_relation(PGLogicalRelation *rel)
+{
+	if (rel->sync_version != SyncingTablesVersion)
+	{
+		rel->syncing = check_syncing_relation(rel->nspname, rel->relname);
+		rel->sync_version = SyncingTablesVersion;
+	}
+
+	return rel->syncing;
 }
 
 static bool
@@ -129,6 +466,14 @@ ensure_transaction(void)
 
 	StartTransactionCommand();
 	MemoryContextSwitchTo(MessageContext);
+
+	/*
+	 * Parallel apply helpers wait for each other's xids, so make sure we
+	 * have one from the start.
+	 */
+	if (MyApplyHelperId >= 0)
+		parallel_apply_helper_xid(GetTopTransactionId());
+
 	return true;
 }
 
@@ -167,11 +512,112 @@ handle_begin(StringInfo s)
 		}
 	}
 
+	/*
+	 * A helper only learns about tables being synchronized from the queued
+	 * messages it applies itself, and the leader applies the following
+	 * transactions until they are synchronized. Refresh the list once we get
+	 * transactions again so that tables which are done stop being skipped.
+	 */
+	if (MyApplyHelperId >= 0 && list_length(SyncingTables) > 0)
+	{
+		bool		started = !IsTransactionState();
+
+		if (started)
+			StartTransactionCommand();
+		reread_unsynced_tables(MyApplyWorker->subid);
+		if (started)
+			CommitTransactionCommand();
+		MemoryContextSwitchTo(MessageContext);
+	}
+
 	in_remote_transaction = true;
 
 	pgstat_report_activity(STATE_RUNNING, NULL);
 }
 
+/*
+ * Commit the local transaction, 'end_lsn' is the end of the last remote
+ * transaction applied in it.
+ */
+static void
+commit_local_transaction(XLogRecPtr end_lsn)
+{
+	release_apply_exec_states();
+
+	/* Other apply processes use the replication origin too. */
+	if (ApplyOriginShared)
+		replorigin_session_setup(replorigin_session_origin);
+
+	CommitTransactionCommand();
+
+	if (ApplyOriginShared)
+		replorigin_session_reset();
+
+	CoalescedCommits = 0;
+
+	/* Track commit lsn, the leader does that for helpers. */
+	if (MyApplyHelperId < 0)
+	{
+		PGLFlushPosition *flushpos;
+
+		MemoryContextSwitchTo(TopMemoryContext);
+		flushpos = (PGLFlushPosition *) palloc(sizeof(PGLFlushPosition));
+		flushpos->local_end = XactLastCommitEnd;
+		flushpos->remote_end = end_lsn;
+
+		dlist_push_tail(&lsn_mapping, &flushpos->node);
+	}
+
+	MemoryContextSwitchTo(MessageContext);
+}
+
+/*
+ * Can the commit of the current remote transaction be coalesced with the
+ * following ones?
+ *
+ * Only the apply worker applying the stream itself does that, and only for
+ * plain transactions which don't need anything done right after the commit.
+ */
+static bool
+can_coalesce_commit(void)
+{
+	return coalesce_commits > 1 &&
+		!CoalesceBreak &&
+		apply_delay == 0 &&
+		ParallelApply == NULL &&
+		MyPGLogicalWorker->worker_type == PGLOGICAL_WORKER_APPLY &&
+		MyApplyWorker->replay_stop_lsn == InvalidXLogRecPtr &&
+		!MyApplyWorker->sync_pending &&
+		list_length(SyncingTables) == 0 &&
+		(remote_origin_id == InvalidRepOriginId ||
+		 remote_origin_id == replorigin_session_origin);
+}
+
+/*
+ * Commit the remote transactions coalesced into the current local
+ * transaction, if any.
+ */
+static void
+flush_coalesced_commits(void)
+{
+	XLogRecPtr		origin_lsn = replorigin_session_origin_lsn;
+	TimestampTz		origin_timestamp = replorigin_session_origin_timestamp;
+
+	if (CoalescedCommits == 0)
+		return;
+
+	Assert(IsTransactionState());
+
+	/* We might be in the next remote transaction already. */
+	replorigin_session_origin_lsn = CoalescedCommitLsn;
+	replorigin_session_origin_timestamp = CoalescedCommitTime;
+
+	commit_local_transaction(CoalescedEndLsn);
+
+	replorigin_session_origin_lsn = origin_lsn;
+	replorigin_session_origin_timestamp = origin_timestamp;
+}
+
 /*
  * Handle COMMIT message.
  */
@@ -180,29 +626,49 @@ handle_commit(StringInfo s)
 {
 	XLogRecPtr		commit_lsn;
 	XLogRecPtr		end_lsn;
+	XLogRecPtr		local_end = InvalidXLogRecPtr;
 	TimestampTz		commit_time;
+	bool			defer = false;
 
 	pglogical_read_commit(s, &commit_lsn, &end_lsn, &commit_time);
 
 	Assert(commit_lsn == replorigin_session_origin_lsn);
 	Assert(commit_time == replorigin_session_origin_timestamp);
 
+	/* Transactions applied by helpers have to commit in order. */
+	if (MyApplyHelperId >= 0)
+		parallel_apply_wait_for_turn();
+
 	if (IsTransactionState())
 	{
-		PGLFlushPosition *flushpos;
+		if (can_coalesce_commit())
+		{
+			TimestampTz		now = GetCurrentTimestamp();
 
-		CommitTransactionCommand();
-		MemoryContextSwitchTo(TopMemoryContext);
+			if (CoalescedCommits++ == 0)
+				CoalesceStart = now;
 
-		/* Track commit lsn  */
-		flushpos = (PGLFlushPosition *) palloc(sizeof(PGLFlushPosition));
-		flushpos->local_end = XactLastCommitEnd;
-		flushpos->remote_end = end_lsn;
+			CoalescedCommitLsn = commit_lsn;
+			CoalescedCommitTime = commit_time;
+			CoalescedEndLsn = end_lsn;
 
-		dlist_push_tail(&lsn_mapping, &flushpos->node);
-		MemoryContextSwitchTo(MessageContext);
+			defer = CoalescedCommits < coalesce_commits &&
+				!TimestampDifferenceExceeds(CoalesceStart, now,
+											COALESCE_MAX_DELAY_MS);
+		}
+
+		if (!defer)
+		{
+			commit_local_transaction(end_lsn);
+			local_end = XactLastCommitEnd;
+		}
 	}
 
+	/* Queued command might have committed the transaction on its own. */
+	if (!defer)
+		CoalescedCommits = 0;
+	CoalesceBreak = false;
+
 	/*
 	 * If the xact isn't from the immediate upstream, advance the slot of the
 	 * node it originally came from so we start replay of that node's change
@@ -243,6 +709,14 @@ handle_commit(StringInfo s)
 
 	in_remote_transaction = false;
 
+	/* Let the leader and the other helpers know we are done. */
+	if (MyApplyHelperId >= 0)
+	{
+		parallel_apply_helper_done(local_end, end_lsn, commit_lsn);
+		pgstat_report_activity(STATE_IDLE, NULL);
+		return;
+	}
+
 	/*
 	 * Stop replay if we're doing limited replay and we've replayed up to the
 	 * last record we're supposed to process.
@@ -281,7 +755,9 @@ handle_commit(StringInfo s)
 		proc_exit(0);
 	}
 
-	process_syncing_tables(end_lsn);
+	/* Coalesced transactions are handled once committed by the main loop. */
+	if (CoalescedCommits == 0)
+		process_syncing_tables(end_lsn);
 
 	pgstat_report_activity(STATE_IDLE, NULL);
 }
@@ -298,9 +774,16 @@ handle_origin(StringInfo s)
 	 * ORIGIN message can only come inside remote transaction and before
 	 * any actual writes.
 	 */
-	if (!in_remote_transaction || IsTransactionState())
+	if (!in_remote_transaction ||
+		(IsTransactionState() && CoalescedCommits == 0))
 		elog(ERROR, "ORIGIN message sent out of order");
 
+	/*
+	 * The transaction might need its own commit, so don't make it part of
+	 * the coalesced ones.
+	 */
+	flush_coalesced_commits();
+
 	/* We have to start transaction here so that we can work with origins. */
 	ensure_transaction();
 
@@ -347,104 +830,192 @@ UserTableUpdateOpenIndexes(EState *estate, TupleTableSlot *slot)
 	return recheckIndexes;
 }
 
-static bool
-physatt_in_attmap(PGLogicalRelation *rel, int attid)
-{
-	AttrNumber	i;
-
-	for (i = 0; i < rel->natts; i++)
-		if (rel->attmap[i] == attid)
-			return true;
-
-	return false;
-}
-
 /*
  * Executes default values for columns for which we didn't get any data.
  *
- * TODO: this needs caching, it's not exactly fast.
+ * The expressions are planned by the relation cache when the remote relation
+ * gets mapped to the local one and initialized with the executor state.
  */
 static void
-fill_missing_defaults(PGLogicalRelation *rel, EState *estate,
-					  PGLogicalTupleData *tuple)
+fill_missing_defaults(ApplyExecState *aestate, PGLogicalTupleData *tuple)
 {
-	TupleDesc	desc = RelationGetDescr(rel->rel);
-	AttrNumber	num_phys_attrs = desc->natts;
-	int			i;
-	AttrNumber	attnum,
-				num_defaults = 0;
-	int		   *defmap;
-	ExprState **defexprs;
 	ExprContext *econtext;
+	int			i;
 
-	econtext = GetPerTupleExprContext(estate);
-
-	/* We got all the data via replication, no need to evaluate anything. */
-	if (num_phys_attrs == rel->natts)
+	if (aestate->ndefaults == 0)
 		return;
 
-	defmap = (int *) palloc(num_phys_attrs * sizeof(int));
-	defexprs = (ExprState **) palloc(num_phys_attrs * sizeof(ExprState *));
+	econtext = GetPerTupleExprContext(aestate->estate);
+
+	for (i = 0; i < aestate->ndefaults; i++)
+		tuple->values[aestate->defmap[i]] =
+			ExecEvalExpr(aestate->defexprs[i], econtext,
+						 &tuple->nulls[aestate->defmap[i]], NULL);
+}
+
+/*
+ * Relcache invalidation callback, mark the cached executor states for
+ * the relation as stale so that they get rebuilt on next use.
+ */
+static void
+apply_exec_state_invalidate_cb(Datum arg, Oid reloid)
+{
+	dlist_iter	iter;
 
-	for (attnum = 0; attnum < num_phys_attrs; attnum++)
+	dlist_foreach(iter, &ApplyExecStates)
 	{
-		Expr	   *defexpr;
+		ApplyExecState *aestate = dlist_container(ApplyExecState, node,
+												  iter.cur);
 
-		if (desc->attrs[attnum]->attisdropped)
-			continue;
+		if (reloid == InvalidOid || aestate->reloid == reloid)
+			aestate->stale = true;
+	}
+}
 
-		if (physatt_in_attmap(rel, attnum))
-			continue;
+/*
+ * Can inserts into the relation be buffered and written in batches?
+ *
+ * Row triggers need to see the individual rows, so we don't batch when
+ * there are any. The conflict detection can't see rows which were not yet
+ * written, so we only batch when the only unique index is the replica
+ * identity one (which is also enforced by the upstream, so the rows within
+ * one remote transaction can't conflict with each other).
+ */
+static bool
+exec_state_can_batch(ApplyExecState *aestate)
+{
+	ResultRelInfo  *relinfo = aestate->resultRelInfo;
+	Oid				replidxoid;
+	int				i;
 
-		defexpr = (Expr *) build_column_default(rel->rel, attnum + 1);
+	if (relinfo->ri_TrigDesc != NULL)
+		return false;
 
-		if (defexpr != NULL)
-		{
-			/* Run the expression through planner */
-			defexpr = expression_planner(defexpr);
+	/* Queued messages have to be processed one by one. */
+	if (aestate->reloid == QueueRelid)
+		return false;
 
-			/* Initialize executable expression in copycontext */
-			defexprs[num_defaults] = ExecInitExpr(defexpr, NULL);
-			defmap[num_defaults] = attnum;
-			num_defaults++;
-		}
+	replidxoid = RelationGetReplicaIndex(aestate->rel);
 
+	for (i = 0; i < relinfo->ri_NumIndices; i++)
+	{
+		IndexInfo  *ii = relinfo->ri_IndexRelationInfo[i];
+
+		if (ii->ii_ExclusionOps != NULL)
+			return false;
+
+		if (ii->ii_Unique &&
+			RelationGetRelid(relinfo->ri_IndexRelationDescs[i]) != replidxoid)
+			return false;
 	}
 
-	for (i = 0; i < num_defaults; i++)
-		tuple->values[defmap[i]] = ExecEvalExpr(defexprs[i],
-												econtext,
-												&tuple->nulls[defmap[i]],
-												NULL);
+	return true;
 }
 
 static ApplyExecState *
-init_apply_exec_state(PGLogicalRelation *rel)
+create_apply_exec_state(PGLogicalRelation *rel)
 {
-	ApplyExecState	   *aestate = palloc0(sizeof(ApplyExecState));
+	static bool			callback_registered = false;
+	ApplyExecState	   *aestate;
+	MemoryContext		oldctx;
+
+	if (!callback_registered)
+	{
+		CacheRegisterRelcacheCallback(apply_exec_state_invalidate_cb,
+									  (Datum) 0);
+		callback_registered = true;
+	}
+
+	/* Make room for the new state. */
+	if (NumApplyExecStates >= MAX_CACHED_EXEC_STATES)
+	{
+		ApplyExecState *victim = dlist_tail_element(ApplyExecState, node,
+													&ApplyExecStates);
+
+		if (InsertBatch != NULL && InsertBatch->aestate == victim)
+			flush_insert_batch();
+		free_apply_exec_state(victim);
+	}
+
+	/*
+	 * The state has to survive until the end of the local transaction, which
+	 * might span several resets of the MessageContext.
+	 */
+	oldctx = MemoryContextSwitchTo(TopTransactionContext);
+
+	aestate = palloc0(sizeof(ApplyExecState));
+	aestate->pglrel = rel;
+	aestate->reloid = RelationGetRelid(rel->rel);
+	aestate->map_version = rel->map_version;
+	/* Lock is already held by the caller. */
+	aestate->rel = heap_open(aestate->reloid, NoLock);
 
 	/* Initialize the executor state. */
-	aestate->estate = create_estate_for_relation(rel->rel, rel->hasTriggers);
+	aestate->estate = create_estate_for_relation(aestate->rel,
+												 rel->hasTriggers);
 	aestate->resultRelInfo = aestate->estate->es_result_relation_info;
 
-	aestate->slot = ExecInitExtraTupleSlot(aestate->estate);
-	ExecSetSlotDescriptor(aestate->slot, RelationGetDescr(rel->rel));
+	aestate->remoteslot = ExecInitExtraTupleSlot(aestate->estate);
+	ExecSetSlotDescriptor(aestate->remoteslot, RelationGetDescr(aestate->rel));
+	aestate->slot = aestate->remoteslot;
+
+	aestate->localslot = ExecInitExtraTupleSlot(aestate->estate);
+	ExecSetSlotDescriptor(aestate->localslot, RelationGetDescr(aestate->rel));
 
 	if (aestate->resultRelInfo->ri_TrigDesc)
 		EvalPlanQualInit(&aestate->epqstate, aestate->estate, NULL, NIL, -1);
 
-	/* Prepare to catch AFTER triggers. */
-	AfterTriggerBeginQuery();
+	ExecOpenIndices(aestate->resultRelInfo
+#if PG_VERSION_NUM >= 90500
+					, false
+#endif
+					);
+
+	aestate->batchable = exec_state_can_batch(aestate);
+
+	/*
+	 * Initialize the default expressions in the executor state memory, the
+	 * function caches they set up on first use must not outlive it. The
+	 * expressions are copied as the mapping can be rebuilt while we are
+	 * still in use.
+	 */
+	aestate->ndefaults = rel->ndefaults;
+	if (rel->ndefaults > 0)
+	{
+		int			i;
+
+		MemoryContextSwitchTo(aestate->estate->es_query_cxt);
+
+		aestate->defmap = (int *) palloc(rel->ndefaults * sizeof(int));
+		aestate->defexprs = (ExprState **)
+			palloc(rel->ndefaults * sizeof(ExprState *));
+		for (i = 0; i < rel->ndefaults; i++)
+		{
+			aestate->defmap[i] = rel->defmap[i];
+			aestate->defexprs[i] = ExecInitExpr(copyObject(rel->defexprs[i]),
+												NULL);
+		}
+	}
+
+	MemoryContextSwitchTo(oldctx);
+
+	dlist_push_head(&ApplyExecStates, &aestate->node);
+	NumApplyExecStates++;
+	rel->exec_state = aestate;
 
 	return aestate;
 }
 
-
 static void
-finish_apply_exec_state(ApplyExecState *aestate)
+free_apply_exec_state(ApplyExecState *aestate)
 {
-	/* Handle queued AFTER triggers. */
-	AfterTriggerEndQuery(aestate->estate);
+	dlist_delete(&aestate->node);
+	NumApplyExecStates--;
+
+	if (aestate->pglrel->exec_state == aestate)
+		aestate->pglrel->exec_state = NULL;
+
+	ExecCloseIndices(aestate->resultRelInfo);
 
 	/* Terminate EPQ execution if active. */
 	EvalPlanQualEnd(&aestate->epqstate);
@@ -454,15 +1025,188 @@ finish_apply_exec_state(ApplyExecState *aestate)
 
 	/* Free the memory. */
 	FreeExecutorState(aestate->estate);
+	heap_close(aestate->rel, NoLock);
 	pfree(aestate);
 }
 
+/*
+ * Release all cached executor states.
+ *
+ * Must be called before the local transaction ends.
+ */
 static void
-handle_insert(StringInfo s)
+release_apply_exec_states(void)
 {
-	PGLogicalTupleData	newtup;
-	PGLogicalRelation  *rel;
-	ApplyExecState	   *aestate;
+	flush_insert_batch();
+
+	while (!dlist_is_empty(&ApplyExecStates))
+		free_apply_exec_state(dlist_head_element(ApplyExecState, node,
+												 &ApplyExecStates));
+
+	Assert(NumApplyExecStates == 0);
+}
+
+/*
+ * Get executor state for applying a change to the relation, reusing the
+ * cached one when possible.
+ *
+ * The cached state is rebuilt when the relation mapping changed since it was
+ * created, for example because the upstream sent the relation metadata again
+ * in the middle of the local transaction, as the default columns it
+ * evaluates may be different.
+ */
+static ApplyExecState *
+init_apply_exec_state(PGLogicalRelation *rel)
+{
+	ApplyExecState	   *aestate = rel->exec_state;
+
+	if (aestate != NULL &&
+		(aestate->stale || aestate->reloid != RelationGetRelid(rel->rel) ||
+		 aestate->map_version != rel->map_version))
+	{
+		if (InsertBatch != NULL && InsertBatch->aestate == aestate)
+			flush_insert_batch();
+		free_apply_exec_state(aestate);
+		aestate = NULL;
+	}
+
+	if (aestate != NULL)
+	{
+		dlist_move_head(&ApplyExecStates, &aestate->node);
+		pg_atomic_fetch_add_u64(&MyApplyWorker->exec_state_reuses, 1);
+	}
+	else
+	{
+		aestate = create_apply_exec_state(rel);
+		pg_atomic_fetch_add_u64(&MyApplyWorker->exec_state_rebuilds, 1);
+	}
+
+	/* Prepare to catch AFTER triggers. */
+	AfterTriggerBeginQuery();
+
+	return aestate;
+}
+
+/*
+ * Finish applying single change, the executor state stays cached for use
+ * by the following changes.
+ */
+static void
+finish_apply_exec_state(ApplyExecState *aestate)
+{
+	ListCell   *lc;
+
+	/* Handle queued AFTER triggers. */
+	AfterTriggerEndQuery(aestate->estate);
+
+	/* Terminate EPQ execution if active. */
+	EvalPlanQualEnd(&aestate->epqstate);
+
+	/*
+	 * Release the tuples before resetting the per-tuple memory as some of
+	 * them were allocated there.
+	 */
+	foreach (lc, aestate->estate->es_tupleTable)
+		ExecClearTuple((TupleTableSlot *) lfirst(lc));
+	aestate->slot = aestate->remoteslot;
+
+	ResetPerTupleExprContext(aestate->estate);
+}
+
+/*
+ * Add tuple to the batch of inserts for the relation.
+ *
+ * The tuple must already be checked for conflicts and constraints.
+ */
+static void
+add_insert_batch(ApplyExecState *aestate, HeapTuple tuple)
+{
+	MemoryContext	oldctx;
+
+	if (InsertBatch == NULL)
+	{
+		InsertBatch = MemoryContextAllocZero(TopMemoryContext,
+											 sizeof(ApplyInsertBatch));
+		InsertBatch->context = AllocSetContextCreate(TopMemoryContext,
+													 "pglogical insert batch",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+	}
+
+	Assert(InsertBatch->aestate == NULL || InsertBatch->aestate == aestate);
+	Assert(InsertBatch->ntuples < MAX_BATCH_INSERT_TUPLES);
+
+	InsertBatch->aestate = aestate;
+
+	oldctx = MemoryContextSwitchTo(InsertBatch->context);
+	InsertBatch->tuples[InsertBatch->ntuples++] = heap_copytuple(tuple);
+	MemoryContextSwitchTo(oldctx);
+
+	InsertBatch->nbytes += tuple->t_len;
+}
+
+static bool
+insert_batch_full(void)
+{
+	return InsertBatch != NULL &&
+		(InsertBatch->ntuples >= MAX_BATCH_INSERT_TUPLES ||
+		 InsertBatch->nbytes >= MAX_BATCH_INSERT_BYTES);
+}
+
+/*
+ * Write out the buffered inserts.
+ *
+ * Must be called before any other change is applied, the rest of apply
+ * can't see the buffered rows.
+ */
+static void
+flush_insert_batch(void)
+{
+	ApplyExecState *aestate;
+	EState		   *estate;
+	int				i;
+
+	if (InsertBatch == NULL || InsertBatch->ntuples == 0)
+		return;
+
+	aestate = InsertBatch->aestate;
+	estate = aestate->estate;
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	heap_multi_insert(aestate->rel, InsertBatch->tuples, InsertBatch->ntuples,
+					  GetCurrentCommandId(true), 0, NULL);
+
+	/* Now insert the index entries for all the new tuples. */
+	if (aestate->resultRelInfo->ri_NumIndices > 0)
+	{
+		for (i = 0; i < InsertBatch->ntuples; i++)
+		{
+			ExecStoreTuple(InsertBatch->tuples[i], aestate->remoteslot,
+						   InvalidBuffer, false);
+			UserTableUpdateOpenIndexes(estate, aestate->remoteslot);
+			ExecClearTuple(aestate->remoteslot);
+			ResetPerTupleExprContext(estate);
+		}
+	}
+
+	PopActiveSnapshot();
+
+	InsertBatch->aestate = NULL;
+	InsertBatch->ntuples = 0;
+	InsertBatch->nbytes = 0;
+	MemoryContextReset(InsertBatch->context);
+
+	CommandCounterIncrement();
+}
+
+static void
+handle_insert(StringInfo s)
+{
+	PGLogicalTupleData *newtup;
+	PGLogicalRelation  *rel;
+	ApplyExecState	   *aestate;
 	Oid					conflicts;
 	TupleTableSlot	   *localslot;
 	HeapTuple			remotetuple;
@@ -471,40 +1215,48 @@ handle_insert(StringInfo s)
 	bool				started_tx = ensure_transaction();
 	List			   *recheckIndexes = NIL;
 	MemoryContext		oldctx;
+	bool				batch;
 
 	rel = pglogical_read_insert(s, RowExclusiveLock, &newtup);
 
 	/* If in list of relations which are being synchronized, skip. */
-	if (check_syncing_relation(rel->nspname, rel->relname))
+	if (check_syncing_remote_relation(rel))
 	{
 		pglogical_relation_close(rel, NoLock);
 		return;
 	}
 
+	/* Only inserts into the same relation are batched together. */
+	if (InsertBatch != NULL && InsertBatch->aestate != NULL &&
+		InsertBatch->aestate->pglrel != rel)
+		flush_insert_batch();
+
 	/* Initialize the executor state. */
 	aestate = init_apply_exec_state(rel);
-	localslot = ExecInitExtraTupleSlot(aestate->estate);
-	ExecSetSlotDescriptor(localslot, RelationGetDescr(rel->rel));
+	localslot = aestate->localslot;
 
 	/* Get snapshot */
 	PushActiveSnapshot(GetTransactionSnapshot());
 
-	ExecOpenIndices(aestate->resultRelInfo
-#if PG_VERSION_NUM >= 90500
-					, false
-#endif
-					);
-
 	/* Check for existing tuple with same key */
-	conflicts = pglogical_tuple_find_conflict(aestate->estate,
-											  &newtup,
+	conflicts = pglogical_tuple_find_conflict(rel, aestate->estate,
+											  newtup,
 											  localslot);
 
+	/*
+	 * Decide if the tuple can be added to the batch, otherwise write out
+	 * the buffered rows first so that they are visible to the code below.
+	 */
+	batch = pglogical_batch_inserts && aestate->batchable &&
+		!OidIsValid(conflicts);
+	if (!batch)
+		flush_insert_batch();
+
 	/* Process and store remote tuple in the slot */
 	oldctx = MemoryContextSwitchTo(GetPerTupleMemoryContext(aestate->estate));
-	fill_missing_defaults(rel, aestate->estate, &newtup);
+	fill_missing_defaults(aestate, newtup);
 	remotetuple = heap_form_tuple(RelationGetDescr(rel->rel),
-								  newtup.values, newtup.nulls);
+								  newtup->values, newtup->nulls);
 	MemoryContextSwitchTo(oldctx);
 	ExecStoreTuple(remotetuple, aestate->slot, InvalidBuffer, true);
 
@@ -559,6 +1311,7 @@ handle_insert(StringInfo s)
 					PopActiveSnapshot();
 					finish_apply_exec_state(aestate);
 					pglogical_relation_close(rel, NoLock);
+					return;
 				}
 
 			}
@@ -584,6 +1337,16 @@ handle_insert(StringInfo s)
 								 NULL, applytuple, recheckIndexes);
 		}
 	}
+	else if (batch)
+	{
+		/* Check the constraints of the tuple */
+		if (rel->rel->rd_att->constr)
+			ExecConstraints(aestate->resultRelInfo, aestate->slot,
+							aestate->estate);
+
+		/* No triggers to fire, it will be written by flush_insert_batch. */
+		add_insert_batch(aestate, remotetuple);
+	}
 	else
 	{
 		/* Check the constraints of the tuple */
@@ -599,8 +1362,6 @@ handle_insert(StringInfo s)
 							 remotetuple, recheckIndexes);
 	}
 
-	ExecCloseIndices(aestate->resultRelInfo);
-
 	PopActiveSnapshot();
 
 	/* if INSERT was into our queue, process the message. */
@@ -619,6 +1380,12 @@ handle_insert(StringInfo s)
 
 		finish_apply_exec_state(aestate);
 
+		/* The queued message can run DDL, don't keep any relations open. */
+		release_apply_exec_states();
+
+		/* Its side effects might need to be seen right after the commit. */
+		CoalesceBreak = true;
+
 		LockRelationIdForSession(&lockid, RowExclusiveLock);
 		pglogical_relation_close(rel, NoLock);
 
@@ -638,6 +1405,9 @@ handle_insert(StringInfo s)
 		/* Otherwise do normal cleanup. */
 		finish_apply_exec_state(aestate);
 		pglogical_relation_close(rel, NoLock);
+
+		if (insert_batch_full())
+			flush_insert_batch();
 	}
 
 	CommandCounterIncrement();
@@ -647,8 +1417,8 @@ handle_insert(StringInfo s)
 static void
 handle_update(StringInfo s)
 {
-	PGLogicalTupleData	oldtup;
-	PGLogicalTupleData	newtup;
+	PGLogicalTupleData *oldtup;
+	PGLogicalTupleData *newtup;
 	PGLogicalTupleData *searchtup;
 	PGLogicalRelation  *rel;
 	ApplyExecState	   *aestate;
@@ -665,7 +1435,7 @@ handle_update(StringInfo s)
 								&newtup);
 
 	/* If in list of relations which are being synchronized, skip. */
-	if (check_syncing_relation(rel->nspname, rel->relname))
+	if (check_syncing_remote_relation(rel))
 	{
 		pglogical_relation_close(rel, NoLock);
 		return;
@@ -673,14 +1443,14 @@ handle_update(StringInfo s)
 
 	/* Initialize the executor state. */
 	aestate = init_apply_exec_state(rel);
-	localslot = ExecInitExtraTupleSlot(aestate->estate);
-	ExecSetSlotDescriptor(localslot, RelationGetDescr(rel->rel));
+	localslot = aestate->localslot;
 
 	PushActiveSnapshot(GetTransactionSnapshot());
 
 	/* Search for existing tuple with same key */
-	searchtup = hasoldtup ? &oldtup : &newtup;
-	found = pglogical_tuple_find_replidx(aestate->estate, searchtup, localslot);
+	searchtup = hasoldtup ? oldtup : newtup;
+	found = pglogical_tuple_find_replidx(rel, aestate->estate, searchtup,
+										 localslot);
 
 	/*
 	 * Tuple found.
@@ -697,12 +1467,12 @@ handle_update(StringInfo s)
 
 		/* Process and store remote tuple in the slot */
 		oldctx = MemoryContextSwitchTo(GetPerTupleMemoryContext(aestate->estate));
-		fill_missing_defaults(rel, aestate->estate, &newtup);
+		fill_missing_defaults(aestate, newtup);
 		remotetuple = heap_modify_tuple(localslot->tts_tuple,
 										RelationGetDescr(rel->rel),
-										newtup.values,
-										newtup.nulls,
-										newtup.changed);
+										newtup->values,
+										newtup->nulls,
+										newtup->changed);
 		MemoryContextSwitchTo(oldctx);
 		ExecStoreTuple(remotetuple, aestate->slot, InvalidBuffer, true);
 
@@ -769,16 +1539,8 @@ handle_update(StringInfo s)
 
 			/* Only update indexes if it's not HOT update. */
 			if (!HeapTupleIsHeapOnly(aestate->slot->tts_tuple))
-			{
-				ExecOpenIndices(aestate->resultRelInfo
-#if PG_VERSION_NUM >= 90500
-								, false
-#endif
-							   );
 				recheckIndexes = UserTableUpdateOpenIndexes(aestate->estate,
 															aestate->slot);
-				ExecCloseIndices(aestate->resultRelInfo);
-			}
 
 			/* AFTER ROW UPDATE Triggers */
 			ExecARUpdateTriggers(aestate->estate, aestate->resultRelInfo,
@@ -794,8 +1556,8 @@ handle_update(StringInfo s)
 		 * We can't do INSERT here because we might not have whole tuple.
 		 */
 		remotetuple = heap_form_tuple(RelationGetDescr(rel->rel),
-									  newtup.values,
-									  newtup.nulls);
+									  newtup->values,
+									  newtup->nulls);
 		pglogical_report_conflict(CONFLICT_UPDATE_DELETE, rel->rel, NULL,
 								  remotetuple, NULL, PGLogicalResolution_Skip);
 	}
@@ -811,7 +1573,7 @@ handle_update(StringInfo s)
 static void
 handle_delete(StringInfo s)
 {
-	PGLogicalTupleData	oldtup;
+	PGLogicalTupleData *oldtup;
 	PGLogicalRelation  *rel;
 	ApplyExecState	   *aestate;
 	TupleTableSlot	   *localslot;
@@ -821,7 +1583,7 @@ handle_delete(StringInfo s)
 	rel = pglogical_read_delete(s, RowExclusiveLock, &oldtup);
 
 	/* If in list of relations which are being synchronized, skip. */
-	if (check_syncing_relation(rel->nspname, rel->relname))
+	if (check_syncing_remote_relation(rel))
 	{
 		pglogical_relation_close(rel, NoLock);
 		return;
@@ -829,12 +1591,12 @@ handle_delete(StringInfo s)
 
 	/* Initialize the executor state. */
 	aestate = init_apply_exec_state(rel);
-	localslot = ExecInitExtraTupleSlot(aestate->estate);
-	ExecSetSlotDescriptor(localslot, RelationGetDescr(rel->rel));
+	localslot = aestate->localslot;
 
 	PushActiveSnapshot(GetTransactionSnapshot());
 
-	if (pglogical_tuple_find_replidx(aestate->estate, &oldtup, localslot))
+	if (pglogical_tuple_find_replidx(rel, aestate->estate, oldtup,
+									 localslot))
 	{
 		if (aestate->resultRelInfo->ri_TrigDesc &&
 			aestate->resultRelInfo->ri_TrigDesc->trig_update_before_row)
@@ -865,7 +1627,7 @@ handle_delete(StringInfo s)
 	{
 		/* The tuple to be deleted could not be found. */
 		HeapTuple remotetuple = heap_form_tuple(RelationGetDescr(rel->rel),
-												oldtup.values, oldtup.nulls);
+												oldtup->values, oldtup->nulls);
 		pglogical_report_conflict(CONFLICT_DELETE_DELETE, rel->rel, NULL,
 								  remotetuple, NULL, PGLogicalResolution_Skip);
 	}
@@ -949,6 +1711,9 @@ handle_startup_param(const char *key, const char *value)
 						 GetDatabaseEncodingName(), value)));
 	}
 
+	if (strcmp(key, "compression") == 0)
+		elog(DEBUG1, "upstream compression: %s", value);
+
 	if (strcmp(key, "forward_changeset_origins") == 0)
 	{
 		bool fwd = parse_bool_param(key, value);
@@ -1094,7 +1859,6 @@ static void
 handle_table_sync(QueuedMessage *queued_message)
 {
 	RangeVar	   *rv;
-	MemoryContext			oldcontext;
 	PGLogicalSyncStatus		*oldsync;
 	PGLogicalSyncStatus		newsync;
 
@@ -1123,12 +1887,19 @@ handle_table_sync(QueuedMessage *queued_message)
 	newsync.status = SYNC_STATUS_INIT;
 	create_local_sync_status(&newsync);
 
-	/* Keep the lists persistent. */
-	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
-	SyncingTables = lappend(SyncingTables,
-							makeRangeVar(pstrdup(rv->schemaname),
-										 pstrdup(rv->relname), -1));
-	MemoryContextSwitchTo(oldcontext);
+	syncing_tables_add(rv->schemaname, rv->relname);
+
+	/* Let the apply worker know it has a new table to synchronize. */
+	if (MyApplyHelperId >= 0)
+	{
+		PGLogicalWorker	   *apply;
+
+		LWLockAcquire(PGLogicalCtx->lock, LW_EXCLUSIVE);
+		apply = pglogical_apply_find(MyDatabaseId, MyApplyWorker->subid);
+		if (pglogical_worker_running(apply))
+			apply->worker.apply.sync_pending = true;
+		LWLockRelease(PGLogicalCtx->lock);
+	}
 }
 
 /*
@@ -1294,6 +2065,13 @@ replication_handler(StringInfo s)
 {
 	char action = pq_getmsgbyte(s);
 
+	/*
+	 * Only consecutive inserts can be batched, anything else has to see the
+	 * batched rows.
+	 */
+	if (action != 'I')
+		flush_insert_batch();
+
 	switch (action)
 	{
 		/* BEGIN */
@@ -1370,105 +2148,1365 @@ get_flush_position(XLogRecPtr *write, XLogRecPtr *flush)
 		}
 		else
 		{
-			/*
-			 * Don't want to uselessly iterate over the rest of the list which
-			 * could potentially be long. Instead get the last element and
-			 * grab the write position from there.
-			 */
-			pos = dlist_tail_element(PGLFlushPosition, node,
-									 &lsn_mapping);
-			*write = pos->remote_end;
-			return false;
+			/*
+			 * Don't want to uselessly iterate over the rest of the list which
+			 * could potentially be long. Instead get the last element and
+			 * grab the write position from there.
+			 */
+			pos = dlist_tail_element(PGLFlushPosition, node,
+									 &lsn_mapping);
+			*write = pos->remote_end;
+			return false;
+		}
+	}
+
+	return dlist_is_empty(&lsn_mapping);
+}
+
+/*
+ * Send a Standby Status Update message to server.
+ *
+ * 'recvpos' is the latest LSN we've received data to, force is set if we need
+ * to send a response to avoid timeouts.
+ */
+static bool
+send_feedback(PGconn *conn, XLogRecPtr recvpos, int64 now, bool force)
+{
+	static StringInfo	reply_message = NULL;
+
+	static XLogRecPtr last_recvpos = InvalidXLogRecPtr;
+	static XLogRecPtr last_writepos = InvalidXLogRecPtr;
+	static XLogRecPtr last_flushpos = InvalidXLogRecPtr;
+
+	XLogRecPtr writepos;
+	XLogRecPtr flushpos;
+
+	/* It's legal to not pass a recvpos */
+	if (recvpos < last_recvpos)
+		recvpos = last_recvpos;
+
+	if (get_flush_position(&writepos, &flushpos))
+	{
+		/*
+		 * No outstanding transactions to flush, we can report the latest
+		 * received position. This is important for synchronous replication.
+		 */
+		flushpos = writepos = recvpos;
+	}
+
+	if (writepos < last_writepos)
+		writepos = last_writepos;
+
+	if (flushpos < last_flushpos)
+		flushpos = last_flushpos;
+
+	/* if we've already reported everything we're good */
+	if (!force &&
+		writepos == last_writepos &&
+		flushpos == last_flushpos)
+		return true;
+
+	if (!reply_message)
+	{
+		MemoryContext	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+		reply_message = makeStringInfo();
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		resetStringInfo(reply_message);
+
+	pq_sendbyte(reply_message, 'r');
+	pq_sendint64(reply_message, recvpos);		/* write */
+	pq_sendint64(reply_message, flushpos);		/* flush */
+	pq_sendint64(reply_message, writepos);		/* apply */
+	pq_sendint64(reply_message, now);			/* sendTime */
+	pq_sendbyte(reply_message, false);			/* replyRequested */
+
+	elog(DEBUG2, "sending feedback (force %d) to recv %X/%X, write %X/%X, flush %X/%X",
+		 force,
+		 (uint32) (recvpos >> 32), (uint32) recvpos,
+		 (uint32) (writepos >> 32), (uint32) writepos,
+		 (uint32) (flushpos >> 32), (uint32) flushpos
+		);
+
+	if (PQputCopyData(conn, reply_message->data, reply_message->len) <= 0 ||
+		PQflush(conn))
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not send feedback packet: %s",
+						PQerrorMessage(conn))));
+		return false;
+	}
+
+	if (recvpos > last_recvpos)
+		last_recvpos = recvpos;
+	if (writepos > last_writepos)
+		last_writepos = writepos;
+	if (flushpos > last_flushpos)
+		last_flushpos = flushpos;
+
+	return true;
+}
+
+/*
+ * Offset of the first helper queue in the parallel apply segment.
+ */
+static Size
+parallel_apply_queue_offset(int nhelpers)
+{
+	return MAXALIGN(add_size(offsetof(ParallelApplyShared, helpers),
+							 mul_size(nhelpers, sizeof(ParallelApplyHelper))));
+}
+
+/*
+ * Create the shared segment and start the helper workers.
+ *
+ * Must be called outside of transaction.
+ */
+static void
+parallel_apply_start(int nhelpers, bool pipelined)
+{
+	Size			queue_offset = parallel_apply_queue_offset(nhelpers);
+	Size			queue_size;
+	Size			size;
+	dsm_segment	   *seg;
+	HASHCTL			ctl;
+	int				hash_flags;
+	int				i;
+
+	Assert(!IsTransactionState());
+	Assert(!pipelined || nhelpers == 1);
+
+	queue_size = pipelined ? PIPELINED_APPLY_QUEUE_SIZE :
+		PARALLEL_APPLY_QUEUE_SIZE;
+	size = add_size(queue_offset, mul_size(nhelpers, queue_size));
+#if PG_VERSION_NUM >= 90500
+	seg = dsm_create(size, 0);
+#else
+	seg = dsm_create(size);
+#endif
+	/* The segment is used for the whole life of the worker. */
+	dsm_pin_mapping(seg);
+
+	ParallelApply = (ParallelApplyShared *) dsm_segment_address(seg);
+	SpinLockInit(&ParallelApply->mutex);
+	ParallelApply->leader = MyProc;
+	ParallelApply->leader_exited = false;
+	ParallelApply->next_commit = 1;
+	ParallelApply->pipelined = pipelined;
+	ParallelApply->queue_size = queue_size;
+	ParallelApply->nhelpers = nhelpers;
+	memset(ParallelApply->helpers, 0, sizeof(ParallelApplyHelper) * nhelpers);
+
+	LWLockAcquire(PGLogicalCtx->lock, LW_SHARED);
+	ParallelApply->leader_slot = MyPGLogicalWorker - &PGLogicalCtx->workers[0];
+	ParallelApply->leader_generation = MyPGLogicalWorker->generation;
+	LWLockRelease(PGLogicalCtx->lock);
+
+	/* Relation messages which we might need to forward to the helpers. */
+	hash_flags = HASH_ELEM | HASH_CONTEXT;
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(ParallelApplyRelation);
+	ctl.hcxt = TopMemoryContext;
+#if PG_VERSION_NUM >= 90500
+	hash_flags |= HASH_BLOBS;
+#else
+	ctl.hash = tag_hash;
+	hash_flags |= HASH_FUNCTION;
+#endif
+	ParallelApplyRelations = hash_create("pglogical parallel apply relations",
+										 128, &ctl, hash_flags);
+
+	ParallelTxnContext = AllocSetContextCreate(TopMemoryContext,
+											   "pglogical parallel apply transaction",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
+
+	/*
+	 * The helpers commit the transactions, so they need to be able to use
+	 * the replication origin.
+	 */
+	replorigin_session_reset();
+	ApplyOriginShared = true;
+
+	ApplyHelpers = (ParallelApplyHelperInfo *)
+		MemoryContextAllocZero(TopMemoryContext,
+							   sizeof(ParallelApplyHelperInfo) * nhelpers);
+
+	for (i = 0; i < nhelpers; i++)
+	{
+		PGLogicalWorker	worker;
+		shm_mq		   *mq;
+		int				slot;
+
+		mq = shm_mq_create((char *) ParallelApply + queue_offset +
+						   i * queue_size, queue_size);
+		shm_mq_set_sender(mq, MyProc);
+		ApplyHelpers[i].mqh = shm_mq_attach(mq, seg, NULL);
+
+		memset(&worker, 0, sizeof(PGLogicalWorker));
+		worker.worker_type = PGLOGICAL_WORKER_APPLY_HELPER;
+		worker.dboid = MyPGLogicalWorker->dboid;
+		worker.worker.helper.apply.subid = MyApplyWorker->subid;
+		worker.worker.helper.apply.sync_pending = false;
+		worker.worker.helper.handle = dsm_segment_handle(seg);
+		worker.worker.helper.helper_id = i;
+
+		slot = pglogical_worker_register(&worker);
+
+		LWLockAcquire(PGLogicalCtx->lock, LW_SHARED);
+		ApplyHelpers[i].slot = slot;
+		ApplyHelpers[i].generation = pglogical_get_worker(slot)->generation;
+		LWLockRelease(PGLogicalCtx->lock);
+
+		/* So that the helpers can check on each other. */
+		ParallelApply->helpers[i].slot = slot;
+		ParallelApply->helpers[i].generation = ApplyHelpers[i].generation;
+	}
+
+	/*
+	 * Make sure the helpers don't outlive us, they would keep their
+	 * transactions open otherwise.
+	 */
+	before_shmem_exit(parallel_apply_leader_exit, (Datum) 0);
+
+	elog(DEBUG1, "started %d %s apply helpers for subscription %s",
+		 nhelpers, pipelined ? "pipelined" : "parallel", MySubscription->name);
+}
+
+/*
+ * Is the worker we started (or were started by) still running?
+ *
+ * The caller must hold PGLogicalCtx->lock.
+ */
+static bool
+parallel_apply_worker_alive(int slot, uint16 generation,
+							PGLogicalWorkerType type)
+{
+	PGLogicalWorker *worker = pglogical_get_worker(slot);
+
+	return worker->generation == generation &&
+		worker->worker_type == type &&
+		pglogical_worker_running(worker);
+}
+
+/*
+ * Terminate the helpers when the leader exits, for whatever reason.
+ *
+ * A helper waiting for its turn to commit would otherwise wait forever,
+ * holding its transaction and its locks, and the restarted apply worker
+ * would block on them when replaying the same transactions.
+ */
+static void
+parallel_apply_leader_exit(int code, Datum arg)
+{
+	int		i;
+
+	if (ParallelApply == NULL)
+		return;
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	ParallelApply->leader_exited = true;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	LWLockAcquire(PGLogicalCtx->lock, LW_EXCLUSIVE);
+	for (i = 0; i < ParallelApply->nhelpers; i++)
+	{
+		ParallelApplyHelper *helper = &ParallelApply->helpers[i];
+
+		if (parallel_apply_worker_alive(helper->slot, helper->generation,
+										PGLOGICAL_WORKER_APPLY_HELPER))
+			pglogical_worker_kill(pglogical_get_worker(helper->slot));
+	}
+	LWLockRelease(PGLogicalCtx->lock);
+}
+
+/*
+ * Make sure all the helpers are still alive, there is no way to continue
+ * without them.
+ */
+static void
+parallel_apply_check_helpers(void)
+{
+	int		i;
+
+	LWLockAcquire(PGLogicalCtx->lock, LW_SHARED);
+	for (i = 0; i < ParallelApply->nhelpers; i++)
+	{
+		if (!parallel_apply_worker_alive(ApplyHelpers[i].slot,
+										 ApplyHelpers[i].generation,
+										 PGLOGICAL_WORKER_APPLY_HELPER))
+		{
+			LWLockRelease(PGLogicalCtx->lock);
+			ereport(ERROR,
+					(errmsg("pglogical apply helper %d for subscription %s exited unexpectedly",
+							i, MySubscription->name)));
+		}
+	}
+	LWLockRelease(PGLogicalCtx->lock);
+}
+
+/*
+ * Process the transactions committed by helpers since last call.
+ *
+ * The transactions commit in dispatch order so we can just walk them by
+ * their sequence number.
+ */
+static void
+parallel_apply_collect(void)
+{
+	uint64		next_commit;
+
+	if (ParallelApply->pipelined)
+	{
+		ParallelApplyHelper *helper = &ParallelApply->helpers[0];
+		PGLFlushPosition   *flushpos;
+
+		/*
+		 * The helper only publishes its latest commit, which is enough as
+		 * the local commits are flushed in order.
+		 */
+		flushpos = (PGLFlushPosition *)
+			MemoryContextAlloc(TopMemoryContext, sizeof(PGLFlushPosition));
+
+		SpinLockAcquire(&ParallelApply->mutex);
+		next_commit = ParallelApply->next_commit;
+		flushpos->local_end = helper->local_end;
+		flushpos->remote_end = helper->remote_end;
+		if (LastCollected + 1 < next_commit)
+			replorigin_session_origin_lsn = helper->commit_lsn;
+		SpinLockRelease(&ParallelApply->mutex);
+
+		if (LastCollected + 1 < next_commit)
+		{
+			dlist_push_tail(&lsn_mapping, &flushpos->node);
+			LastCollected = next_commit - 1;
+		}
+		else
+			pfree(flushpos);
+
+		return;
+	}
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	next_commit = ParallelApply->next_commit;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	while (LastCollected + 1 < next_commit)
+	{
+		uint64		seqno = LastCollected + 1;
+		int			i;
+
+		for (i = 0; i < ParallelApply->nhelpers; i++)
+		{
+			ParallelApplyHelper *helper = &ParallelApply->helpers[i];
+
+			if (ApplyHelpers[i].seqno != seqno)
+				continue;
+
+			/* Track commit lsn, same as handle_commit() does. */
+			if (helper->local_end != InvalidXLogRecPtr)
+			{
+				PGLFlushPosition   *flushpos;
+
+				flushpos = (PGLFlushPosition *)
+					MemoryContextAlloc(TopMemoryContext,
+									   sizeof(PGLFlushPosition));
+				flushpos->local_end = helper->local_end;
+				flushpos->remote_end = helper->remote_end;
+
+				dlist_push_tail(&lsn_mapping, &flushpos->node);
+			}
+
+			replorigin_session_origin_lsn = helper->commit_lsn;
+			ApplyHelpers[i].seqno = 0;
+			break;
+		}
+
+		Assert(i < ParallelApply->nhelpers);
+		LastCollected = seqno;
+	}
+}
+
+/*
+ * Wait for helpers to make some progress.
+ */
+static void
+parallel_apply_wait(void)
+{
+	int		rc;
+
+	rc = WaitLatch(&MyProc->procLatch,
+				   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 1000L);
+
+	ResetLatch(&MyProc->procLatch);
+
+	/* emergency bailout if postmaster has died */
+	if (rc & WL_POSTMASTER_DEATH)
+		proc_exit(1);
+
+	CHECK_FOR_INTERRUPTS();
+
+	if (got_SIGTERM)
+		proc_exit(0);
+
+	parallel_apply_check_helpers();
+	parallel_apply_collect();
+
+	/* Keep the upstream informed while we are not reading the stream. */
+	send_feedback(applyconn, InvalidXLogRecPtr, GetCurrentTimestamp(), false);
+}
+
+/*
+ * Are all dispatched transactions committed?
+ */
+static bool
+parallel_apply_idle(void)
+{
+	parallel_apply_collect();
+
+	return LastCollected == LastDispatched;
+}
+
+static void
+parallel_apply_wait_all(void)
+{
+	while (!parallel_apply_idle())
+		parallel_apply_wait();
+}
+
+/*
+ * Remember the relation definition so that it can be forwarded to helpers
+ * and update our own relation cache.
+ */
+static ParallelApplyRelation *
+parallel_apply_record_relation(StringInfo s)
+{
+	uint32		remoteid = pglogical_peek_relid(s);
+	ParallelApplyRelation *entry;
+	MemoryContext	oldctx;
+	bool		found;
+
+	entry = hash_search(ParallelApplyRelations, (void *) &remoteid,
+						HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->version = 0;
+		entry->msg = NULL;
+		memset(entry->sent_version, 0, sizeof(entry->sent_version));
+		entry->last_seqno = 0;
+		entry->last_txn = 0;
+		entry->pending = NULL;
+		entry->natts = 0;
+		entry->keyattlens = NULL;
+		entry->key_seqno = NULL;
+		entry->last_rel_seqno = 0;
+	}
+
+	entry->version++;
+
+	/*
+	 * The keys might not be comparable with the new definition, so make the
+	 * following transactions depend on everything before.
+	 */
+	entry->last_rel_seqno = entry->last_seqno;
+	if (entry->key_seqno != NULL)
+		memset(entry->key_seqno, 0,
+			   PARALLEL_APPLY_KEY_SLOTS * sizeof(uint64));
+	if (entry->last_txn == PendingTxn && entry->pending != NULL)
+	{
+		entry->pending->whole = true;
+		PendingDependsOn = Max(PendingDependsOn, entry->last_seqno);
+	}
+
+	oldctx = MemoryContextSwitchTo(TopMemoryContext);
+	if (entry->msg == NULL)
+		entry->msg = makeStringInfo();
+	else
+		resetStringInfo(entry->msg);
+	appendBinaryStringInfo(entry->msg, s->data + s->cursor,
+						   s->len - s->cursor);
+	MemoryContextSwitchTo(oldctx);
+
+	return entry;
+}
+
+/*
+ * Is the equality of the type the same as equality of its representation in
+ * the protocol?
+ */
+static bool
+parallel_apply_key_type(Oid typid)
+{
+	switch (typid)
+	{
+		case BOOLOID:
+		case CHAROID:
+		case NAMEOID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case OIDOID:
+		case TEXTOID:
+		case VARCHAROID:
+		case BYTEAOID:
+		case UUIDOID:
+		case DATEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Get lengths of the key columns of the local relation (zero for the other
+ * columns) indexed by position in the remote relation, or NULL if changes
+ * can't be tracked per key.
+ *
+ * That's only safe when the replica identity is the only way two changes of
+ * the local table can conflict: the local replica identity index has to be
+ * on the remote replica identity columns, there must not be any other unique
+ * or exclusion index and no trigger that might look at other rows. Equal
+ * values of the key columns must also be sent the same way.
+ */
+static int16 *
+parallel_apply_key_columns(PGLogicalRelation *rel, Relation localrel,
+						   Bitmapset *identity)
+{
+	TupleDesc	desc = RelationGetDescr(localrel);
+	Oid			replidxoid = RelationGetReplicaIndex(localrel);
+	Bitmapset  *keyattnums = NULL;
+	int16	   *keyattlens;
+	List	   *indexes;
+	ListCell   *lc;
+	bool		usable = true;
+	int			i;
+
+	if (!OidIsValid(replidxoid))
+		return NULL;
+
+	if (localrel->trigdesc != NULL)
+	{
+		TriggerDesc	   *trigdesc = localrel->trigdesc;
+
+		for (i = 0; i < trigdesc->numtriggers; i++)
+		{
+			Trigger *trigger = &trigdesc->triggers[i];
+
+			/* Only replica triggers fire during apply. */
+			if (!(trigger->tgenabled == TRIGGER_FIRES_ON_ORIGIN ||
+				  trigger->tgenabled == TRIGGER_DISABLED))
+				return NULL;
+		}
+	}
+
+	keyattlens = (int16 *) palloc0(rel->natts * sizeof(int16));
+	for (i = 0; i < rel->natts; i++)
+	{
+		AttrNumber	attnum;
+		Form_pg_attribute att;
+
+		if (!bms_is_member(i, identity))
+			continue;
+
+		attnum = get_attnum(RelationGetRelid(localrel), rel->attnames[i]);
+		if (attnum <= 0)
+			return NULL;
+
+		att = desc->attrs[attnum - 1];
+		if (!parallel_apply_key_type(att->atttypid))
+			return NULL;
+
+		keyattlens[i] = att->attlen;
+		keyattnums = bms_add_member(keyattnums, attnum);
+	}
+
+	indexes = RelationGetIndexList(localrel);
+	foreach (lc, indexes)
+	{
+		Oid			idxoid = lfirst_oid(lc);
+		Relation	idxrel = index_open(idxoid, AccessShareLock);
+		Form_pg_index idx = idxrel->rd_index;
+
+		if (idxoid == replidxoid)
+		{
+			Bitmapset  *idxattnums = NULL;
+
+			for (i = 0; i < idx->indnatts; i++)
+				idxattnums = bms_add_member(idxattnums, idx->indkey.values[i]);
+
+			if (!bms_equal(idxattnums, keyattnums))
+				usable = false;
+		}
+		else if (idx->indisunique || idx->indisexclusion)
+			usable = false;
+
+		index_close(idxrel, AccessShareLock);
+	}
+	list_free(indexes);
+
+	if (!usable)
+		return NULL;
+
+	return keyattlens;
+}
+
+/*
+ * Decide whether changes of the relation can be tracked per replica identity
+ * key, after its definition was received.
+ */
+static void
+parallel_apply_relation_keys(ParallelApplyRelation *entry,
+							 Bitmapset *identity)
+{
+	PGLogicalRelation *rel = pglogical_relation_cache_find(entry->remoteid);
+	MemoryContext	oldctx = CurrentMemoryContext;
+	Relation		localrel;
+	int16		   *keyattlens = NULL;
+	bool			started;
+
+	if (entry->keyattlens != NULL)
+		pfree(entry->keyattlens);
+	entry->keyattlens = NULL;
+
+	if (rel == NULL || bms_is_empty(identity))
+		return;
+
+	started = !IsTransactionState();
+	if (started)
+		StartTransactionCommand();
+
+	localrel = heap_openrv_extended(makeRangeVar(rel->nspname, rel->relname,
+												 -1),
+									AccessShareLock, true);
+	if (localrel != NULL)
+	{
+		keyattlens = parallel_apply_key_columns(rel, localrel, identity);
+		heap_close(localrel, AccessShareLock);
+	}
+
+	if (keyattlens != NULL)
+	{
+		entry->natts = rel->natts;
+		entry->keyattlens = (int16 *)
+			MemoryContextAlloc(TopMemoryContext, rel->natts * sizeof(int16));
+		memcpy(entry->keyattlens, keyattlens, rel->natts * sizeof(int16));
+
+		if (entry->key_seqno == NULL)
+			entry->key_seqno = (uint64 *)
+				MemoryContextAllocZero(TopMemoryContext,
+									   PARALLEL_APPLY_KEY_SLOTS * sizeof(uint64));
+	}
+
+	if (started)
+	{
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(oldctx);
+	}
+}
+
+/*
+ * Add message to the buffered transaction.
+ */
+static void
+parallel_apply_buffer(StringInfo s)
+{
+	MemoryContext	oldctx = MemoryContextSwitchTo(ParallelTxnContext);
+	StringInfo		msg = makeStringInfo();
+
+	appendBinaryStringInfo(msg, s->data + s->cursor, s->len - s->cursor);
+	PendingMsgs = lappend(PendingMsgs, msg);
+	PendingSize += msg->len;
+
+	MemoryContextSwitchTo(oldctx);
+}
+
+/*
+ * Track relation and rows changed by the buffered transaction.
+ *
+ * The transaction has to wait for the previous ones which changed the same
+ * rows, or the same relation if we can't tell which rows those are.
+ */
+static void
+parallel_apply_touch_relation(StringInfo s)
+{
+	uint32		remoteid = pglogical_peek_relid(s);
+	ParallelApplyRelation *entry;
+	PGLogicalRelation *rel;
+	PendingRelation *pending;
+	MemoryContext	oldctx;
+	uint32		hashes[2];
+	int			nhashes;
+	int			i;
+
+	entry = hash_search(ParallelApplyRelations, (void *) &remoteid,
+						HASH_FIND, NULL);
+	rel = pglogical_relation_cache_find(remoteid);
+
+	/* Should not happen, but let the normal apply deal with it. */
+	if (entry == NULL || rel == NULL)
+	{
+		PendingSerial = true;
+		return;
+	}
+
+	oldctx = MemoryContextSwitchTo(ParallelTxnContext);
+
+	if (entry->last_txn != PendingTxn)
+	{
+		entry->last_txn = PendingTxn;
+
+		/* The queue messages can do pretty much anything. */
+		if (strcmp(rel->nspname, EXTENSION_NAME) == 0)
+			PendingSerial = true;
+
+		pending = (PendingRelation *) palloc(sizeof(PendingRelation));
+		pending->entry = entry;
+		pending->version = entry->version;
+		pending->msg = makeStringInfo();
+		appendBinaryStringInfo(pending->msg, entry->msg->data,
+							   entry->msg->len);
+		pending->whole = false;
+		pending->keyslots = NULL;
+		PendingRelations = lappend(PendingRelations, pending);
+		entry->pending = pending;
+	}
+	else
+		pending = entry->pending;
+
+	if (!pending->whole)
+	{
+		if (entry->keyattlens != NULL &&
+			pglogical_peek_change_keys(s, entry->natts, entry->keyattlens,
+									   hashes, &nhashes))
+		{
+			PendingDependsOn = Max(PendingDependsOn, entry->last_rel_seqno);
+
+			for (i = 0; i < nhashes; i++)
+			{
+				int		slot = hashes[i] % PARALLEL_APPLY_KEY_SLOTS;
+
+				PendingDependsOn = Max(PendingDependsOn,
+									   entry->key_seqno[slot]);
+				pending->keyslots = bms_add_member(pending->keyslots, slot);
+			}
+		}
+		else
+		{
+			pending->whole = true;
+			PendingDependsOn = Max(PendingDependsOn, entry->last_seqno);
+		}
+	}
+
+	MemoryContextSwitchTo(oldctx);
+}
+
+static void
+parallel_apply_reset_pending(void)
+{
+	ListCell   *lc;
+
+	foreach (lc, PendingRelations)
+		((PendingRelation *) lfirst(lc))->entry->pending = NULL;
+
+	MemoryContextReset(ParallelTxnContext);
+	PendingMsgs = NIL;
+	PendingRelations = NIL;
+	PendingRedefined = NIL;
+	PendingSize = 0;
+	PendingSerial = false;
+	PendingDependsOn = 0;
+	PendingCommitLsn = InvalidXLogRecPtr;
+}
+
+static void
+parallel_apply_replay_message(StringInfo msg)
+{
+	StringInfoData	s;
+
+	s.data = msg->data;
+	s.len = msg->len;
+	s.maxlen = -1;
+	s.cursor = 0;
+
+	replication_handler(&s);
+}
+
+/*
+ * Apply the buffered part of transaction ourselves.
+ *
+ * The caller must make sure no helper is applying anything.
+ */
+static void
+parallel_apply_replay(void)
+{
+	ListCell   *lc;
+
+	Assert(LastCollected == LastDispatched);
+
+	/*
+	 * Our relation cache has the latest definitions, but the changes in the
+	 * buffer were made with whatever definition was current at that time.
+	 */
+	foreach (lc, PendingRelations)
+	{
+		PendingRelation *pending = (PendingRelation *) lfirst(lc);
+
+		if (pending->version != pending->entry->version)
+			parallel_apply_replay_message(pending->msg);
+	}
+
+	foreach (lc, PendingMsgs)
+		parallel_apply_replay_message((StringInfo) lfirst(lc));
+}
+
+static void
+parallel_apply_send(int helper, StringInfo msg)
+{
+	for (;;)
+	{
+		shm_mq_result	res;
+
+		res = shm_mq_send(ApplyHelpers[helper].mqh, msg->len, msg->data,
+						  true);
+
+		if (res == SHM_MQ_SUCCESS)
+			break;
+		else if (res == SHM_MQ_DETACHED)
+			ereport(ERROR,
+					(errmsg("pglogical apply helper %d for subscription %s exited unexpectedly",
+							helper, MySubscription->name)));
+
+		parallel_apply_wait();
+	}
+}
+
+static int
+parallel_apply_free_helper(void)
+{
+	int		i;
+
+	for (i = 0; i < ParallelApply->nhelpers; i++)
+	{
+		if (ApplyHelpers[i].seqno == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Hand over the buffered transaction to a helper.
+ */
+static void
+parallel_apply_dispatch(void)
+{
+	uint64		depends_on = PendingDependsOn;
+	uint64		seqno;
+	int			helper;
+	ListCell   *lc;
+
+	if (PendingSerial || list_length(SyncingTables) > 0)
+	{
+		parallel_apply_wait_all();
+		parallel_apply_replay();
+		return;
+	}
+
+	/*
+	 * Changes to the same rows have to be applied in order, so wait until
+	 * the last previous transaction touching any of them commits.
+	 */
+	for (;;)
+	{
+		parallel_apply_collect();
+
+		if (LastCollected >= depends_on &&
+			(helper = parallel_apply_free_helper()) >= 0)
+			break;
+
+		parallel_apply_wait();
+	}
+
+	seqno = ++LastDispatched;
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	ParallelApply->helpers[helper].seqno = seqno;
+	ParallelApply->helpers[helper].xid = InvalidTransactionId;
+	ParallelApply->helpers[helper].local_end = InvalidXLogRecPtr;
+	ParallelApply->helpers[helper].remote_end = InvalidXLogRecPtr;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	ApplyHelpers[helper].seqno = seqno;
+
+	/* Send relation definitions the helper has not seen yet. */
+	foreach (lc, PendingRelations)
+	{
+		PendingRelation *pending = (PendingRelation *) lfirst(lc);
+
+		if (pending->entry->sent_version[helper] != pending->version)
+			parallel_apply_send(helper, pending->msg);
+	}
+
+	foreach (lc, PendingMsgs)
+		parallel_apply_send(helper, (StringInfo) lfirst(lc));
+
+	/* The helper knows the latest definitions now. */
+	foreach (lc, PendingRelations)
+	{
+		PendingRelation *pending = (PendingRelation *) lfirst(lc);
+
+		ParallelApplyRelation *entry = pending->entry;
+		int			slot;
+
+		entry->sent_version[helper] = entry->version;
+		entry->last_seqno = seqno;
+
+		if (pending->whole)
+			entry->last_rel_seqno = seqno;
+		else
+		{
+			while ((slot = bms_first_member(pending->keyslots)) >= 0)
+				entry->key_seqno[slot] = seqno;
+		}
+	}
+	foreach (lc, PendingRedefined)
+	{
+		ParallelApplyRelation *entry = (ParallelApplyRelation *) lfirst(lc);
+
+		entry->sent_version[helper] = entry->version;
+	}
+}
+
+/*
+ * Handle replication message when parallel apply is enabled.
+ */
+static void
+parallel_apply_message(StringInfo s)
+{
+	char		action = s->data[s->cursor];
+
+	if (action == 'R')
+	{
+		ParallelApplyRelation *entry = parallel_apply_record_relation(s);
+		Bitmapset  *identity = pglogical_peek_rel_identity(s);
+
+		if (in_remote_transaction && !ApplyingLocally)
+		{
+			MemoryContext	oldctx;
+
+			parallel_apply_buffer(s);
+
+			oldctx = MemoryContextSwitchTo(ParallelTxnContext);
+			PendingRedefined = lappend(PendingRedefined, entry);
+			MemoryContextSwitchTo(oldctx);
+		}
+
+		/* Update our own cache too. */
+		replication_handler(s);
+
+		parallel_apply_relation_keys(entry, identity);
+		return;
+	}
+
+	if (ApplyingLocally)
+	{
+		replication_handler(s);
+		if (action == 'C')
+			ApplyingLocally = false;
+		return;
+	}
+
+	switch (action)
+	{
+		case 'B':
+			{
+				StringInfoData	copy;
+				TimestampTz		commit_time;
+				TransactionId	remote_xid;
+
+				parallel_apply_reset_pending();
+				PendingTxn++;
+
+				memcpy(&copy, s, sizeof(StringInfoData));
+				(void) pq_getmsgbyte(&copy);
+				pglogical_read_begin(&copy, &PendingCommitLsn, &commit_time,
+									 &remote_xid);
+
+				parallel_apply_buffer(s);
+				in_remote_transaction = true;
+				break;
+			}
+		case 'I':
+		case 'U':
+		case 'D':
+			parallel_apply_touch_relation(s);
+			parallel_apply_buffer(s);
+			break;
+		case 'O':
+			parallel_apply_buffer(s);
+			break;
+		case 'C':
+			parallel_apply_buffer(s);
+			parallel_apply_dispatch();
+			parallel_apply_reset_pending();
+			in_remote_transaction = false;
+			return;
+		default:
+			replication_handler(s);
+			return;
+	}
+
+	/*
+	 * Don't buffer huge transactions, apply them ourselves once the helpers
+	 * are done.
+	 */
+	if (PendingSize > PARALLEL_APPLY_MAX_TXN_SIZE)
+	{
+		parallel_apply_wait_all();
+		parallel_apply_replay();
+		parallel_apply_reset_pending();
+		ApplyingLocally = true;
+	}
+}
+
+/*
+ * Handle replication message in the pipelined mode.
+ */
+static void
+pipeline_apply_message(StringInfo s)
+{
+	char			action = s->data[s->cursor];
+	StringInfoData	msg;
+
+	/*
+	 * The table synchronization needs to know exactly what was applied, so
+	 * apply transactions ourselves while there are tables being synchronized.
+	 */
+	if (action == 'B')
+	{
+		if (MyApplyWorker->sync_pending)
+		{
+			parallel_apply_wait_all();
+
+			StartTransactionCommand();
+			MyApplyWorker->sync_pending = false;
+			reread_unsynced_tables(MyApplyWorker->subid);
+			CommitTransactionCommand();
+			MemoryContextSwitchTo(MessageContext);
+		}
+
+		if (list_length(SyncingTables) > 0)
+		{
+			parallel_apply_wait_all();
+			ApplyingLocally = true;
+		}
+	}
+
+	/* The helper needs to know all relations, startup is ours. */
+	if (action == 'R' || action == 'S' || ApplyingLocally)
+	{
+		StringInfoData	copy;
+
+		memcpy(&copy, s, sizeof(StringInfoData));
+		replication_handler(&copy);
+
+		if (ApplyingLocally && action == 'C')
+			ApplyingLocally = false;
+
+		if (action != 'R')
+			return;
+	}
+
+	msg.data = s->data + s->cursor;
+	msg.len = s->len - s->cursor;
+	msg.maxlen = -1;
+	msg.cursor = 0;
+
+	parallel_apply_send(0, &msg);
+
+	if (action == 'B')
+		in_remote_transaction = true;
+	else if (action == 'C')
+	{
+		LastDispatched++;
+		in_remote_transaction = false;
+	}
+}
+
+/*
+ * Publish the local xid of the transaction applied by this helper so that
+ * the following helper can wait for it.
+ */
+static void
+parallel_apply_helper_xid(TransactionId xid)
+{
+	ParallelApplyHelper *me = &ParallelApply->helpers[MyApplyHelperId];
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	me->xid = xid;
+	SpinLockRelease(&ParallelApply->mutex);
+}
+
+/*
+ * Make sure the leader and the helper applying the transaction we wait for
+ * (if any, -1 otherwise) are still alive.
+ *
+ * If either of them is gone, the transactions before ours will never be
+ * committed (an aborted one just makes XactLockTableWait return), so we
+ * have to give up and let the restarted apply worker replay them.
+ */
+static void
+parallel_apply_check_leader(int prev_helper)
+{
+	bool		leader_exited;
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	leader_exited = ParallelApply->leader_exited;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	if (leader_exited)
+		ereport(ERROR,
+				(errmsg("pglogical apply worker for subscription %s has exited",
+						MySubscription->name)));
+
+	LWLockAcquire(PGLogicalCtx->lock, LW_SHARED);
+	if (!parallel_apply_worker_alive(ParallelApply->leader_slot,
+									 ParallelApply->leader_generation,
+									 PGLOGICAL_WORKER_APPLY))
+	{
+		LWLockRelease(PGLogicalCtx->lock);
+		ereport(ERROR,
+				(errmsg("pglogical apply worker for subscription %s exited unexpectedly",
+						MySubscription->name)));
+	}
+	if (prev_helper >= 0 &&
+		!parallel_apply_worker_alive(ParallelApply->helpers[prev_helper].slot,
+									 ParallelApply->helpers[prev_helper].generation,
+									 PGLOGICAL_WORKER_APPLY_HELPER))
+	{
+		LWLockRelease(PGLogicalCtx->lock);
+		ereport(ERROR,
+				(errmsg("pglogical apply helper %d for subscription %s exited unexpectedly",
+						prev_helper, MySubscription->name)));
+	}
+	LWLockRelease(PGLogicalCtx->lock);
+}
+
+/*
+ * Wait until all the transactions dispatched before ours are committed.
+ */
+static void
+parallel_apply_wait_for_turn(void)
+{
+	ParallelApplyHelper *me = &ParallelApply->helpers[MyApplyHelperId];
+
+	/* We are the only one applying anything. */
+	if (ParallelApply->pipelined)
+		return;
+
+	for (;;)
+	{
+		TransactionId	prev_xid = InvalidTransactionId;
+		int				prev_helper = -1;
+		uint64			next_commit;
+		int				i;
+		int				rc;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (got_SIGTERM)
+			proc_exit(0);
+
+		SpinLockAcquire(&ParallelApply->mutex);
+		next_commit = ParallelApply->next_commit;
+		for (i = 0; i < ParallelApply->nhelpers; i++)
+		{
+			if (ParallelApply->helpers[i].seqno == next_commit)
+			{
+				prev_xid = ParallelApply->helpers[i].xid;
+				prev_helper = i;
+			}
+		}
+		SpinLockRelease(&ParallelApply->mutex);
+
+		if (next_commit == me->seqno)
+			break;
+
+		parallel_apply_check_leader(prev_helper);
+
+		/*
+		 * Wait on the transaction lock if possible so that deadlock detector
+		 * knows about us in case the previous transaction waits for a lock
+		 * we hold.
+		 */
+		if (IsTransactionState() && TransactionIdIsValid(prev_xid) &&
+			TransactionIdIsInProgress(prev_xid))
+		{
+			XactLockTableWait(prev_xid, NULL, NULL, XLTW_None);
+			continue;
 		}
-	}
 
-	return dlist_is_empty(&lsn_mapping);
+		rc = WaitLatch(&MyProc->procLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 10L);
+
+		ResetLatch(&MyProc->procLatch);
+
+		/* emergency bailout if postmaster has died */
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+	}
 }
 
 /*
- * Send a Standby Status Update message to server.
- *
- * 'recvpos' is the latest LSN we've received data to, force is set if we need
- * to send a response to avoid timeouts.
+ * Report our transaction as committed and let the next one proceed.
  */
-static bool
-send_feedback(PGconn *conn, XLogRecPtr recvpos, int64 now, bool force)
+static void
+parallel_apply_helper_done(XLogRecPtr local_end, XLogRecPtr remote_end,
+						   XLogRecPtr commit_lsn)
 {
-	static StringInfo	reply_message = NULL;
+	ParallelApplyHelper *me = &ParallelApply->helpers[MyApplyHelperId];
+	int			i;
 
-	static XLogRecPtr last_recvpos = InvalidXLogRecPtr;
-	static XLogRecPtr last_writepos = InvalidXLogRecPtr;
-	static XLogRecPtr last_flushpos = InvalidXLogRecPtr;
+	SpinLockAcquire(&ParallelApply->mutex);
+	/*
+	 * In pipelined mode the leader might only see our latest commit, so keep
+	 * the last local commit position if this transaction had nothing to do.
+	 */
+	if (local_end != InvalidXLogRecPtr || !ParallelApply->pipelined)
+		me->local_end = local_end;
+	me->remote_end = remote_end;
+	me->commit_lsn = commit_lsn;
+	me->xid = InvalidTransactionId;
+	ParallelApply->next_commit++;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	SetLatch(&ParallelApply->leader->procLatch);
+	for (i = 0; i < ParallelApply->nhelpers; i++)
+	{
+		if (i != MyApplyHelperId && ParallelApply->helpers[i].proc)
+			SetLatch(&ParallelApply->helpers[i].proc->procLatch);
+	}
+}
 
-	XLogRecPtr writepos;
-	XLogRecPtr flushpos;
+/*
+ * Apply single protocol message received from the upstream.
+ */
+static void
+apply_message(StringInfo s)
+{
+	if (ParallelApply && ParallelApply->pipelined)
+		pipeline_apply_message(s);
+	else if (ParallelApply)
+		parallel_apply_message(s);
+	else
+		replication_handler(s);
+}
 
-	/* It's legal to not pass a recvpos */
-	if (recvpos < last_recvpos)
-		recvpos = last_recvpos;
+/*
+ * Apply batch of protocol messages sent by the upstream in one CopyData
+ * message. Each message in the batch is prefixed by its length.
+ */
+static void
+apply_message_batch(StringInfo s)
+{
+	(void) pq_getmsgbyte(s);
 
-	if (get_flush_position(&writepos, &flushpos))
+	while (s->cursor < s->len)
 	{
-		/*
-		 * No outstanding transactions to flush, we can report the latest
-		 * received position. This is important for synchronous replication.
-		 */
-		flushpos = writepos = recvpos;
-	}
+		StringInfoData	msg;
+		int				len = pq_getmsgint(s, 4);
 
-	if (writepos < last_writepos)
-		writepos = last_writepos;
+		msg.data = (char *) pq_getmsgbytes(s, len);
+		msg.len = len;
+		msg.maxlen = -1;
+		msg.cursor = 0;
 
-	if (flushpos < last_flushpos)
-		flushpos = last_flushpos;
+		apply_message(&msg);
+	}
+}
 
-	/* if we've already reported everything we're good */
-	if (!force &&
-		writepos == last_writepos &&
-		flushpos == last_flushpos)
-		return true;
+/*
+ * Decompress a 'Z' message and apply its content.
+ *
+ * The upstream compresses the whole replication stream using a single
+ * compression stream, so our decompression state has to be kept for the
+ * lifetime of the connection.
+ */
+static void
+apply_compressed_message(StringInfo s)
+{
+#ifdef HAVE_LIBZ
+	uint32			rawlen;
+	StringInfoData	raw;
+	int				rc;
 
-	if (!reply_message)
+	(void) pq_getmsgbyte(s);
+	rawlen = pq_getmsgint(s, 4);
+
+	if (StreamInflate == NULL)
 	{
-		MemoryContext	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
-		reply_message = makeStringInfo();
-		MemoryContextSwitchTo(oldcontext);
+		StreamInflate = MemoryContextAllocZero(TopMemoryContext,
+											   sizeof(z_stream));
+		if (inflateInit(StreamInflate) != Z_OK)
+			elog(ERROR, "could not initialize decompression: %s",
+				 StreamInflate->msg ? StreamInflate->msg : "unknown error");
 	}
-	else
-		resetStringInfo(reply_message);
-
-	pq_sendbyte(reply_message, 'r');
-	pq_sendint64(reply_message, recvpos);		/* write */
-	pq_sendint64(reply_message, flushpos);		/* flush */
-	pq_sendint64(reply_message, writepos);		/* apply */
-	pq_sendint64(reply_message, now);			/* sendTime */
-	pq_sendbyte(reply_message, false);			/* replyRequested */
 
-	elog(DEBUG2, "sending feedback (force %d) to recv %X/%X, write %X/%X, flush %X/%X",
-		 force,
-		 (uint32) (recvpos >> 32), (uint32) recvpos,
-		 (uint32) (writepos >> 32), (uint32) writepos,
-		 (uint32) (flushpos >> 32), (uint32) flushpos
-		);
+	raw.data = palloc(rawlen + 1);
+	raw.len = rawlen;
+	raw.maxlen = rawlen + 1;
+	raw.cursor = 0;
 
-	if (PQputCopyData(conn, reply_message->data, reply_message->len) <= 0 ||
-		PQflush(conn))
-	{
+	/*
+	 * Leave space for one more byte so that inflate() consumes the whole
+	 * input including the flush marker.
+	 */
+	StreamInflate->next_in = (Bytef *) (s->data + s->cursor);
+	StreamInflate->avail_in = s->len - s->cursor;
+	StreamInflate->next_out = (Bytef *) raw.data;
+	StreamInflate->avail_out = rawlen + 1;
+
+	rc = inflate(StreamInflate, Z_SYNC_FLUSH);
+	if ((rc != Z_OK && rc != Z_BUF_ERROR) ||
+		StreamInflate->avail_in != 0 || StreamInflate->avail_out != 1)
 		ereport(ERROR,
-				(errcode(ERRCODE_CONNECTION_FAILURE),
-				 errmsg("could not send feedback packet: %s",
-						PQerrorMessage(conn))));
-		return false;
-	}
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("could not decompress message from upstream: %s",
+						StreamInflate->msg ? StreamInflate->msg :
+						"unexpected message length")));
 
-	if (recvpos > last_recvpos)
-		last_recvpos = recvpos;
-	if (writepos > last_writepos)
-		last_writepos = writepos;
-	if (flushpos > last_flushpos)
-		last_flushpos = flushpos;
+	raw.data[rawlen] = '\0';
+	s->cursor = s->len;
 
-	return true;
+	apply_payload(&raw);
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("received compressed message from upstream but compression is not supported by this build")));
+#endif
+}
+
+/*
+ * Apply content of CopyData message received from the upstream, which is
+ * a compressed message, batch of messages or a single message.
+ */
+static void
+apply_payload(StringInfo s)
+{
+	char		c = s->cursor < s->len ? s->data[s->cursor] : '\0';
+
+	if (c == 'Z')
+		apply_compressed_message(s);
+	else if (c == 'M')
+		apply_message_batch(s);
+	else
+		apply_message(s);
 }
 
 /*
@@ -1484,6 +3522,12 @@ apply_work(PGconn *streamConn)
 	applyconn = streamConn;
 	fd = PQsocket(applyconn);
 
+#ifdef HAVE_LIBZ
+	/* New connection means new compression stream. */
+	if (StreamInflate != NULL)
+		inflateReset(StreamInflate);
+#endif
+
 	/* Init the MessageContext which we use for easier cleanup. */
 	MessageContext = AllocSetContextCreate(TopMemoryContext,
 										   "MessageContext",
@@ -1584,7 +3628,7 @@ apply_work(PGconn *streamConn)
 					if (last_received < end_lsn)
 						last_received = end_lsn;
 
-					replication_handler(&s);
+					apply_payload(&s);
 				}
 				else if (c == 'k')
 				{
@@ -1595,6 +3639,13 @@ apply_work(PGconn *streamConn)
 					/* timestamp = */ pq_getmsgint64(&s);
 					reply_requested = pq_getmsgbyte(&s);
 
+					/* Helpers might not have committed everything yet. */
+					if (ParallelApply && !parallel_apply_idle())
+						endpos = InvalidXLogRecPtr;
+
+					/* Don't report position we have not committed yet. */
+					flush_coalesced_commits();
+
 					send_feedback(applyconn, endpos,
 								  GetCurrentTimestamp(),
 								  reply_requested);
@@ -1603,11 +3654,26 @@ apply_work(PGconn *streamConn)
 			}
 		}
 
+		/* No more data for now, commit whatever we have applied. */
+		flush_coalesced_commits();
+
 		/* confirm all writes at once */
-		send_feedback(applyconn, last_received, GetCurrentTimestamp(), false);
+		if (ParallelApply && !parallel_apply_idle())
+			send_feedback(applyconn, InvalidXLogRecPtr, GetCurrentTimestamp(),
+						  false);
+		else
+			send_feedback(applyconn, last_received, GetCurrentTimestamp(),
+						  false);
 
 		if (!in_remote_transaction)
+		{
+			/* Table synchronization needs everything received to be applied. */
+			if (ParallelApply &&
+				(MyApplyWorker->sync_pending || list_length(SyncingTables) > 0))
+				parallel_apply_wait_all();
+
 			process_syncing_tables(last_received);
+		}
 
 		/* Cleanup the memory. */
 		MemoryContextResetAndDeleteChildren(MessageContext);
@@ -1717,7 +3783,6 @@ pglogical_execute_sql_command(char *cmdstr, char *role, bool isTopLevel)
 static void
 reread_unsynced_tables(Oid subid)
 {
-	MemoryContext	saved_ctx;
 	List		   *unsynced_tables;
 	ListCell	   *lc;
 
@@ -1732,6 +3797,7 @@ reread_unsynced_tables(Oid subid)
 
 			next = lnext(lc);
 
+			syncing_tables_forget(rv);
 			pfree(rv->schemaname);
 			pfree(rv->relname);
 			pfree(rv);
@@ -1745,16 +3811,12 @@ reread_unsynced_tables(Oid subid)
 
 	/* Read new state. */
 	unsynced_tables = get_unsynced_tables(subid);
-	saved_ctx = MemoryContextSwitchTo(TopMemoryContext);
 	foreach (lc, unsynced_tables)
 	{
 		RangeVar	   *rv = lfirst(lc);
-		SyncingTables = lappend(SyncingTables,
-								makeRangeVar(pstrdup(rv->schemaname),
-											 pstrdup(rv->relname), -1));
-	}
 
-	MemoryContextSwitchTo(saved_ctx);
+		syncing_tables_add(rv->schemaname, rv->relname);
+	}
 }
 
 static void
@@ -1837,6 +3899,7 @@ process_syncing_tables(XLogRecPtr end_lsn)
 			if (status == SYNC_STATUS_READY)
 			{
 				SyncingTables = list_delete_cell(SyncingTables, lc, prev);
+				syncing_tables_forget(rv);
 				pfree(rv->schemaname);
 				pfree(rv->relname);
 				pfree(rv);
@@ -1914,6 +3977,31 @@ interval_to_timeoffset(const Interval *interval)
 	return span;
 }
 
+/*
+ * Setup the session for applying changes.
+ */
+static void
+apply_setup_session(void)
+{
+	/* Setup synchronous commit according to the user's wishes */
+	SetConfigOption("synchronous_commit",
+					pglogical_synchronous_commit ? "local" : "off",
+					PGC_BACKEND, PGC_S_OVERRIDE);	/* other context? */
+
+	/* Run as replica session replication role. */
+	SetConfigOption("session_replication_role", "replica",
+					PGC_SUSET, PGC_S_OVERRIDE);	/* other context? */
+
+	/*
+	 * Disable function body checks during replay. That's necessary because a)
+	 * the creator of the function might have had it disabled b) the function
+	 * might be search_path dependant and we don't fix the contents of
+	 * functions.
+	 */
+	SetConfigOption("check_function_bodies", "off",
+					PGC_INTERNAL, PGC_S_OVERRIDE);
+}
+
 void
 pglogical_apply_main(Datum main_arg)
 {
@@ -1941,23 +4029,7 @@ pglogical_apply_main(Datum main_arg)
 	/* Connect to our database. */
 	BackgroundWorkerInitializeConnectionByOid(MyPGLogicalWorker->dboid, InvalidOid);
 
-	/* Setup synchronous commit according to the user's wishes */
-	SetConfigOption("synchronous_commit",
-					pglogical_synchronous_commit ? "local" : "off",
-					PGC_BACKEND, PGC_S_OVERRIDE);	/* other context? */
-
-	/* Run as replica session replication role. */
-	SetConfigOption("session_replication_role", "replica",
-					PGC_SUSET, PGC_S_OVERRIDE);	/* other context? */
-
-	/*
-	 * Disable function body checks during replay. That's necessary because a)
-	 * the creator of the function might have had it disabled b) the function
-	 * might be search_path dependant and we don't fix the contents of
-	 * functions.
-	 */
-	SetConfigOption("check_function_bodies", "off",
-					PGC_INTERNAL, PGC_S_OVERRIDE);
+	apply_setup_session();
 
 	/* Load the subscription. */
 	StartTransactionCommand();
@@ -1973,6 +4045,8 @@ pglogical_apply_main(Datum main_arg)
 		apply_delay =
 			interval_to_timeoffset(MySubscription->apply_delay) / 1000;
 
+	coalesce_commits = MySubscription->coalesce_commits;
+
 	/* If the subscription isn't initialized yet, initialize it. */
 	pglogical_sync_subscription(MySubscription);
 
@@ -2007,11 +4081,17 @@ pglogical_apply_main(Datum main_arg)
 	pglogical_identify_system(streamConn, NULL, NULL, NULL, NULL);
 
 	pglogical_start_replication(streamConn, MySubscription->slot_name,
-								origin_startpos, origins, repsets, NULL);
+								origin_startpos, origins, repsets, NULL,
+								MySubscription->compression);
 	pfree(repsets);
 
 	CommitTransactionCommand();
 
+	if (pglogical_parallel_apply_workers > 0)
+		parallel_apply_start(pglogical_parallel_apply_workers, false);
+	else if (pglogical_pipelined_apply)
+		parallel_apply_start(1, true);
+
 	apply_work(streamConn);
 
 	PQfinish(streamConn);
@@ -2019,3 +4099,134 @@ pglogical_apply_main(Datum main_arg)
 	/* We should only get here if we received sigTERM */
 	proc_exit(0);
 }
+
+/*
+ * Parallel apply helper.
+ *
+ * Applies the transactions handed over by the apply worker. Exits when the
+ * apply worker goes away.
+ */
+void
+pglogical_apply_helper_main(Datum main_arg)
+{
+	int				slot = DatumGetInt32(main_arg);
+	PGLogicalApplyHelperWorker *helper;
+	dsm_segment	   *seg;
+	shm_mq		   *mq;
+	shm_mq_handle  *mqh;
+	MemoryContext	saved_ctx;
+
+	/* Setup shmem. */
+	pglogical_worker_attach(slot, PGLOGICAL_WORKER_APPLY_HELPER);
+	Assert(MyPGLogicalWorker->worker_type == PGLOGICAL_WORKER_APPLY_HELPER);
+	helper = &MyPGLogicalWorker->worker.helper;
+	MyApplyWorker = &helper->apply;
+	MyApplyHelperId = helper->helper_id;
+
+	/* Establish signal handlers. */
+	pqsignal(SIGTERM, handle_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+	/* Attach to dsm segment. */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "pglogical apply helper");
+
+	seg = dsm_attach(helper->handle);
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	dsm_pin_mapping(seg);
+
+	ParallelApply = (ParallelApplyShared *) dsm_segment_address(seg);
+	ParallelApply->helpers[MyApplyHelperId].proc = MyProc;
+
+	mq = (shm_mq *) ((char *) ParallelApply +
+					 parallel_apply_queue_offset(ParallelApply->nhelpers) +
+					 MyApplyHelperId * ParallelApply->queue_size);
+	shm_mq_set_receiver(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	/* Connect to our database. */
+	BackgroundWorkerInitializeConnectionByOid(MyPGLogicalWorker->dboid, InvalidOid);
+
+	apply_setup_session();
+
+	/* Load the subscription. */
+	StartTransactionCommand();
+	saved_ctx = MemoryContextSwitchTo(TopMemoryContext);
+	MySubscription = get_subscription(MyApplyWorker->subid);
+	MemoryContextSwitchTo(saved_ctx);
+
+	QueueRelid = get_queue_table_oid();
+
+	/* The origin session is only setup while committing. */
+	replorigin_session_origin = replorigin_by_name(MySubscription->slot_name,
+												   false);
+	ApplyOriginShared = true;
+	CommitTransactionCommand();
+
+	/* Set apply delay if any. */
+	if (MySubscription->apply_delay)
+		apply_delay =
+			interval_to_timeoffset(MySubscription->apply_delay) / 1000;
+
+	elog(DEBUG1, "starting apply helper %d for subscription %s",
+		 MyApplyHelperId, MySubscription->name);
+
+	/* Init the MessageContext which we use for easier cleanup. */
+	MessageContext = AllocSetContextCreate(TopMemoryContext,
+										   "MessageContext",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+
+	/* mark as idle, before starting to loop */
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	while (!got_SIGTERM)
+	{
+		shm_mq_result	res;
+		Size			len;
+		void		   *data;
+		int				rc;
+
+		MemoryContextSwitchTo(MessageContext);
+
+		res = shm_mq_receive(mqh, &len, &data, true);
+
+		if (res == SHM_MQ_SUCCESS)
+		{
+			StringInfoData	s;
+
+			s.data = data;
+			s.len = len;
+			s.maxlen = -1;
+			s.cursor = 0;
+
+			replication_handler(&s);
+
+			/* Cleanup the memory. */
+			MemoryContextResetAndDeleteChildren(MessageContext);
+			continue;
+		}
+		else if (res == SHM_MQ_DETACHED)
+		{
+			/* The apply worker has exited. */
+			break;
+		}
+
+		rc = WaitLatch(&MyProc->procLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 1000L);
+
+		ResetLatch(&MyProc->procLatch);
+
+		/* emergency bailout if postmaster has died */
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	proc_exit(0);
+}
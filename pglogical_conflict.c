@@ -43,61 +43,31 @@
 int      pglogical_conflict_resolver = PGLOGICAL_RESOLVE_APPLY_REMOTE;
 
 /*
- * Setup a ScanKey for a search in the relation 'rel' for a tuple 'key' that
- * is setup to match 'rel' (*NOT* idxrel!).
+ * Setup a ScanKey for a search in the index described by 'keyinfo' for a
+ * tuple 'tup' that is setup to match the heap relation (*NOT* the index!).
  *
  * Returns whether any column contains NULLs.
  */
 static bool
-build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, PGLogicalTupleData *tup)
+build_index_scan_key(ScanKey skey, PGLogicalIndexKeyInfo *keyinfo,
+					 PGLogicalTupleData *tup)
 {
 	int			attoff;
-	Datum		indclassDatum;
-	Datum		indkeyDatum;
-	bool		isnull;
-	oidvector  *opclass;
-	int2vector  *indkey;
 	bool		hasnulls = false;
 
-	indclassDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
-									Anum_pg_index_indclass, &isnull);
-	Assert(!isnull);
-	opclass = (oidvector *) DatumGetPointer(indclassDatum);
-
-	indkeyDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
-								  Anum_pg_index_indkey, &isnull);
-	Assert(!isnull);
-	indkey = (int2vector *) DatumGetPointer(indkeyDatum);
-
-	for (attoff = 0; attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
+	for (attoff = 0; attoff < keyinfo->nkeys; attoff++)
 	{
-		Oid			operator;
-		Oid			opfamily;
-		RegProcedure regop;
-		int			pkattno = attoff + 1;
-		int			mainattno = indkey->values[attoff];
-		Oid			atttype = attnumTypeId(rel, mainattno);
-		Oid			optype = get_opclass_input_type(opclass->values[attoff]);
-
-		opfamily = get_opclass_family(opclass->values[attoff]);
-
-		operator = get_opfamily_member(opfamily, optype,
-									   optype,
-									   BTEqualStrategyNumber);
-
-		if (!OidIsValid(operator))
-			elog(ERROR,
-				 "could not lookup equality operator for type %u, optype %u in opfamily %u",
-				 atttype, optype, opfamily);
-
-		regop = get_opcode(operator);
+		int			mainattno = keyinfo->attnums[attoff];
 
 		/* FIXME: convert type? */
-		ScanKeyInit(&skey[attoff],
-					pkattno,
-					BTEqualStrategyNumber,
-					regop,
-					tup->values[mainattno - 1]);
+		ScanKeyEntryInitializeWithInfo(&skey[attoff],
+									   0,
+									   attoff + 1,
+									   BTEqualStrategyNumber,
+									   InvalidOid,
+									   keyinfo->collations[attoff],
+									   &keyinfo->eqfuncs[attoff],
+									   tup->values[mainattno - 1]);
 
 		if (tup->nulls[mainattno - 1])
 		{
@@ -114,10 +84,17 @@ build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, PGLogicalTuple
  *
  * If a matching tuple is found lock it with lockmode, fill the slot with its
  * contents and return true, return false is returned otherwise.
+ *
+ * The slot does not get a copy of the tuple, it references the tuple in the
+ * shared buffer (keeping it pinned) using 'tuplebuf' for the tuple header.
+ * The slot contents are thus only valid until the next lookup using the same
+ * 'tuplebuf', callers that need the tuple for longer must materialize the
+ * slot.
  */
 static bool
 find_index_tuple(ScanKey skey, Relation rel, Relation idxrel,
-				 LockTupleMode lockmode, TupleTableSlot *slot)
+				 LockTupleMode lockmode, TupleTableSlot *slot,
+				 HeapTuple tuplebuf)
 {
 	HeapTuple	scantuple;
 	bool		found;
@@ -138,9 +115,14 @@ retry:
 	if ((scantuple = index_getnext(scan, ForwardScanDirection)) != NULL)
 	{
 		found = true;
-		/* FIXME: Improve TupleSlot to not require copying the whole tuple */
-		ExecStoreTuple(scantuple, slot, InvalidBuffer, false);
-		ExecMaterializeSlot(slot);
+
+		/*
+		 * The scan's tuple header goes away with the scan, so keep our own
+		 * copy of it and let the slot hold its own pin on the buffer.
+		 */
+		ExecClearTuple(slot);
+		*tuplebuf = *scantuple;
+		ExecStoreTuple(tuplebuf, slot, scan->xs_cbuf, false);
 
 		xwait = TransactionIdIsValid(snap.xmin) ?
 			snap.xmin : snap.xmax;
@@ -198,30 +180,29 @@ retry:
  * Find tuple using REPLICA IDENTITY index.
  */
 bool
-pglogical_tuple_find_replidx(EState *estate, PGLogicalTupleData *tuple,
+pglogical_tuple_find_replidx(PGLogicalRelation *rel, EState *estate,
+							 PGLogicalTupleData *tuple,
 							 TupleTableSlot *oldslot)
 {
 	ResultRelInfo  *relinfo = estate->es_result_relation_info;
-	Oid				idxoid;
 	Relation		idxrel;
 	ScanKeyData		index_key[INDEX_MAX_KEYS];
 	bool			found;
 
-	/* Open REPLICA IDENTITY index.*/
-	idxoid = RelationGetReplicaIndex(relinfo->ri_RelationDesc);
-	if (!OidIsValid(idxoid))
+	/* Open REPLICA IDENTITY index, resolved by relation cache. */
+	if (rel->replidx == NULL)
 	{
 		elog(ERROR, "could not find primary key for table with oid %u",
 			 RelationGetRelid(relinfo->ri_RelationDesc));
 	}
-	idxrel = index_open(idxoid, RowExclusiveLock);
+	idxrel = index_open(rel->replidx->indexoid, RowExclusiveLock);
 
-	/* Buold scan key for just opened index*/
-	build_index_scan_key(index_key, relinfo->ri_RelationDesc, idxrel, tuple);
+	/* Build scan key for just opened index */
+	build_index_scan_key(index_key, rel->replidx, tuple);
 
 	/* Try to find the row. */
 	found = find_index_tuple(index_key, relinfo->ri_RelationDesc, idxrel,
-							 LockTupleExclusive, oldslot);
+							 LockTupleExclusive, oldslot, &rel->localtup);
 
 	/* Don't release lock until commit. */
 	index_close(idxrel, NoLock);
@@ -233,7 +214,8 @@ pglogical_tuple_find_replidx(EState *estate, PGLogicalTupleData *tuple,
  * Find the tuple in a table using any index.
  */
 Oid
-pglogical_tuple_find_conflict(EState *estate, PGLogicalTupleData *tuple,
+pglogical_tuple_find_conflict(PGLogicalRelation *rel, EState *estate,
+							  PGLogicalTupleData *tuple,
 							  TupleTableSlot *oldslot)
 {
 	Oid		conflict_idx = InvalidOid;
@@ -263,13 +245,15 @@ pglogical_tuple_find_conflict(EState *estate, PGLogicalTupleData *tuple,
 
 		idxrel = relinfo->ri_IndexRelationDescs[i];
 
-		if (build_index_scan_key(index_key, relinfo->ri_RelationDesc,
-								 idxrel, tuple))
+		if (build_index_scan_key(index_key,
+								 pglogical_relation_index_keyinfo(rel, idxrel),
+								 tuple))
 			continue;
 
 		/* Try to find conflicting row. */
 		found = find_index_tuple(index_key, relinfo->ri_RelationDesc,
-								 idxrel, LockTupleExclusive, oldslot);
+								 idxrel, LockTupleExclusive, oldslot,
+								 &rel->localtup);
 
 		/* Alert if there's more than one conflicting unique key, we can't
 		 * currently handle that situation. */
@@ -47,11 +47,13 @@ typedef enum PGLogicalConflictType
 	CONFLICT_DELETE_DELETE
 } PGLogicalConflictType;
 
-extern bool pglogical_tuple_find_replidx(EState *estate,
+extern bool pglogical_tuple_find_replidx(PGLogicalRelation *rel,
+										 EState *estate,
 										 PGLogicalTupleData *tuple,
 										 TupleTableSlot *oldslot);
 
-extern Oid pglogical_tuple_find_conflict(EState *estate,
+extern Oid pglogical_tuple_find_conflict(PGLogicalRelation *rel,
+										 EState *estate,
 										 PGLogicalTupleData *tuple,
 										 TupleTableSlot *oldslot);
 
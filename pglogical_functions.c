@@ -98,6 +98,7 @@ PG_FUNCTION_INFO_V1(pglogical_alter_subscription_resynchronize_table);
 
 PG_FUNCTION_INFO_V1(pglogical_show_subscription_table);
 PG_FUNCTION_INFO_V1(pglogical_show_subscription_status);
+PG_FUNCTION_INFO_V1(pglogical_show_subscription_stats);
 
 /* Replication set manipulation. */
 PG_FUNCTION_INFO_V1(pglogical_create_replication_set);
@@ -374,6 +375,8 @@ pglogical_create_subscription(PG_FUNCTION_ARGS)
 	bool					sync_data = PG_GETARG_BOOL(4);
 	ArrayType			   *forward_origin_names = PG_GETARG_ARRAYTYPE_P(5);
 	Interval			   *apply_delay = PG_GETARG_INTERVAL_P(6);
+	int						coalesce_commits = PG_GETARG_INT32(7);
+	bool					compression = PG_GETARG_BOOL(8);
 	PGconn				   *conn;
 	PGLogicalSubscription	sub;
 	PGLogicalSyncStatus		sync;
@@ -390,6 +393,19 @@ pglogical_create_subscription(PG_FUNCTION_ARGS)
 	/* Check that this is actually a node. */
 	localnode = get_local_node(true, false);
 
+	if (coalesce_commits < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("coalesce_commits must not be negative")));
+
+#ifndef HAVE_LIBZ
+	if (compression)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("compression is not supported by this build"),
+				 errhint("pglogical must be built against PostgreSQL configured with zlib.")));
+#endif
+
 	/* Now, fetch info about remote node. */
 	conn = pglogical_connect(provider_dsn, sub_name, "create");
 	pglogical_remote_node_info(conn, &origin.id, &origin.name, NULL, NULL, NULL);
@@ -488,6 +504,8 @@ pglogical_create_subscription(PG_FUNCTION_ARGS)
 				  origin.name, sub_name);
 	sub.slot_name = pstrdup(NameStr(slot_name));
 	sub.apply_delay = apply_delay;
+	sub.coalesce_commits = coalesce_commits;
+	sub.compression = compression;
 
 	create_subscription(&sub);
 
@@ -909,6 +927,8 @@ sync_status_to_string(char status)
 			return "sync_structure";
 		case SYNC_STATUS_DATA:
 			return "sync_data";
+		case SYNC_STATUS_DATA_PARTIAL:
+			return "sync_data_partial";
 		case SYNC_STATUS_CONSTAINTS:
 			return "sync_constraints";
 		case SYNC_STATUS_SYNCWAIT:
@@ -1099,6 +1119,108 @@ pglogical_show_subscription_status(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
+/*
+ * Show apply statistics of subscriptions.
+ */
+Datum
+pglogical_show_subscription_stats(PG_FUNCTION_ARGS)
+{
+	List			   *subscriptions;
+	ListCell		   *lc;
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc			tupdesc;
+	Tuplestorestate	   *tupstore;
+	PGLogicalLocalNode *node;
+	MemoryContext		per_query_ctx;
+	MemoryContext		oldcontext;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	node = check_local_node(false);
+
+	if (PG_ARGISNULL(0))
+	{
+		subscriptions = get_node_subscriptions(node->node->id, false);
+	}
+	else
+	{
+		PGLogicalSubscription  *sub;
+		sub = get_subscription_by_name(NameStr(*PG_GETARG_NAME(0)), false);
+		subscriptions = list_make1(sub);
+	}
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	foreach (lc, subscriptions)
+	{
+		PGLogicalSubscription  *sub = lfirst(lc);
+		uint64	reuses = 0;
+		uint64	rebuilds = 0;
+		Datum	values[3];
+		bool	nulls[3];
+		int		i;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		/*
+		 * Statistics are only available while the apply worker runs. With
+		 * parallel apply the changes are applied by the helpers, which count
+		 * into their own slots, so add up the apply worker and all of its
+		 * running helpers.
+		 */
+		LWLockAcquire(PGLogicalCtx->lock, LW_SHARED);
+		for (i = 0; i < PGLogicalCtx->total_workers; i++)
+		{
+			PGLogicalWorker	   *w = &PGLogicalCtx->workers[i];
+
+			if ((w->worker_type != PGLOGICAL_WORKER_APPLY &&
+				 w->worker_type != PGLOGICAL_WORKER_APPLY_HELPER) ||
+				w->dboid != MyDatabaseId ||
+				w->worker.apply.subid != sub->id ||
+				!pglogical_worker_running(w))
+				continue;
+
+			reuses += pg_atomic_read_u64(&w->worker.apply.exec_state_reuses);
+			rebuilds +=
+				pg_atomic_read_u64(&w->worker.apply.exec_state_rebuilds);
+		}
+		LWLockRelease(PGLogicalCtx->lock);
+
+		values[0] = CStringGetTextDatum(sub->name);
+		values[1] = Int64GetDatum((int64) reuses);
+		values[2] = Int64GetDatum((int64) rebuilds);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	PG_RETURN_VOID();
+}
+
 /*
  * Create new replication set.
  */
@@ -2064,141 +2186,180 @@ filter_tuple(HeapTuple htup, ExprContext *econtext, List *row_filter_list)
 	return true;
 }
 
+/* Scan state of pglogical_table_data_filtered kept between calls. */
+typedef struct TableDataFilteredState
+{
+	Relation		rel;
+	HeapScanDesc	scandesc;
+	EState		   *estate;
+	ExprContext	   *econtext;
+	List		   *row_filter_list;
+	TupleDesc		tupdesc;
+} TableDataFilteredState;
+
+/*
+ * Release the scan, called both at the end of the scan and when the caller
+ * stops reading the rows early.
+ */
+static void
+table_data_filtered_cleanup(Datum arg)
+{
+	TableDataFilteredState *state = (TableDataFilteredState *) DatumGetPointer(arg);
+
+	ExecDropSingleTupleTableSlot(state->econtext->ecxt_scantuple);
+	FreeExecutorState(state->estate);
+
+	heap_endscan(state->scandesc);
+	heap_close(state->rel, NoLock);
+}
+
 /*
  * Do sequential table scan and return all rows that pass the row filter(s)
  * defined in speficied replication set(s) for a table.
  *
  * This is called by downstream sync worker on the upstream to obtain
  * filtered data for initial COPY.
+ *
+ * The rows are returned one per call rather than materialized, so when the
+ * function is called in the select list the caller gets the rows as the
+ * table is scanned, without spilling the whole result to temp files first.
  */
 Datum
 pglogical_table_data_filtered(PG_FUNCTION_ARGS)
 {
-	Oid			argtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
-	Oid			reloid;
- 	ArrayType  *rep_set_names;
-	ReturnSetInfo *rsi;
-	Relation	rel;
-	List	   *replication_sets;
-	ListCell   *lc;
-	TupleDesc	tupdesc;
-	TupleDesc	reltupdesc;
-	HeapScanDesc scandesc;
+	ReturnSetInfo *rsi = (ReturnSetInfo *) fcinfo->resultinfo;
+	FuncCallContext *funcctx;
+	TableDataFilteredState *state;
 	HeapTuple	htup;
-	List	   *row_filter_list = NIL;
-	EState		   *estate;
-	ExprContext	   *econtext;
-	Tuplestorestate *tupstore;
-	PGLogicalLocalNode *node;
-	PGLogicalTableRepInfo *tableinfo;
-	MemoryContext per_query_ctx;
-	MemoryContext oldcontext;
 
-	node = get_local_node(false, false);
+	if (SRF_IS_FIRSTCALL())
+	{
+		Oid			argtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
+		Oid			reloid;
+		ArrayType  *rep_set_names;
+		List	   *replication_sets;
+		ListCell   *lc;
+		TupleDesc	tupdesc;
+		TupleDesc	reltupdesc;
+		PGLogicalLocalNode *node;
+		PGLogicalTableRepInfo *tableinfo;
+		MemoryContext oldcontext;
 
-	/* Validate parameter. */
-	if (PG_ARGISNULL(1))
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("relation cannot be NULL")));
-	if (PG_ARGISNULL(2))
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("repsets cannot be NULL")));
+		node = get_local_node(false, false);
 
-	reloid = PG_GETARG_OID(1);
-	rep_set_names = PG_GETARG_ARRAYTYPE_P(2);
+		/* Validate parameter. */
+		if (PG_ARGISNULL(1))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("relation cannot be NULL")));
+		if (PG_ARGISNULL(2))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("repsets cannot be NULL")));
 
-	if (!type_is_rowtype(argtype))
-		ereport(ERROR,
-				(errcode(ERRCODE_DATATYPE_MISMATCH),
-				 errmsg("first argument of %s must be a row type",
-						"pglogical_table_data_filtered")));
+		reloid = PG_GETARG_OID(1);
+		rep_set_names = PG_GETARG_ARRAYTYPE_P(2);
 
-	rsi = (ReturnSetInfo *) fcinfo->resultinfo;
+		if (!type_is_rowtype(argtype))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("first argument of %s must be a row type",
+							"pglogical_table_data_filtered")));
 
-	if (!rsi || !IsA(rsi, ReturnSetInfo) ||
-		(rsi->allowedModes & SFRM_Materialize) == 0 ||
-		rsi->expectedDesc == NULL)
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("set-valued function called in context that "
-						"cannot accept a set")));
+		if (!rsi || !IsA(rsi, ReturnSetInfo) ||
+			(rsi->allowedModes & SFRM_ValuePerCall) == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("set-valued function called in context that "
+							"cannot accept a set")));
 
-	/* Switch into long-lived context to construct returned data structures */
-	per_query_ctx = rsi->econtext->ecxt_per_query_memory;
-	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+		funcctx = SRF_FIRSTCALL_INIT();
 
-	/*
-	 * get the tupdesc from the result set info - it must be a record type
-	 * because we already checked that arg1 is a record type, or we're in a
-	 * to_record function which returns a setof record.
-	 */
-	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("function returning record called in context "
-						"that cannot accept type record")));
-	tupdesc = BlessTupleDesc(tupdesc);
+		/* Switch into long-lived context to construct the scan state. */
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
-	/* Prepare output tuple store. */
-	tupstore = tuplestore_begin_heap(false, false, work_mem);
-	rsi->returnMode = SFRM_Materialize;
-	rsi->setResult = tupstore;
-	rsi->setDesc = tupdesc;
+		/*
+		 * get the tupdesc from the result set info - it must be a record
+		 * type because we already checked that arg1 is a record type.
+		 */
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("function returning record called in context "
+							"that cannot accept type record")));
+		tupdesc = BlessTupleDesc(tupdesc);
+
+		state = palloc0(sizeof(TableDataFilteredState));
+		state->tupdesc = tupdesc;
+
+		/* Check output type and table row type are the same. */
+		state->rel = heap_open(reloid, AccessShareLock);
+		reltupdesc = RelationGetDescr(state->rel);
+		if (!equalTupleDescs(tupdesc, reltupdesc))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("return type of %s must be same as row type of the relation",
+							"pglogical_table_data_filtered")));
 
-	MemoryContextSwitchTo(oldcontext);
+		/* Build the replication info for the table. */
+		replication_sets = textarray_to_list(rep_set_names);
+		replication_sets = get_replication_sets(node->node->id,
+												replication_sets,
+												false);
+		tableinfo = get_table_replication_info(node->node->id, state->rel,
+											   replication_sets);
+
+		/* Prepare executor. */
+		state->estate = create_estate_for_relation(state->rel, false);
+		state->econtext = prepare_per_tuple_econtext(state->estate,
+													 reltupdesc);
+
+		/* Prepare the row filter expression. */
+		foreach (lc, tableinfo->row_filter)
+		{
+			Node	   *row_filter = (Node *) lfirst(lc);
+			ExprState  *exprstate = pglogical_prepare_row_filter(row_filter);
 
-	/* Check output type and table row type are the same. */
-	rel = heap_open(reloid, AccessShareLock);
-	reltupdesc = RelationGetDescr(rel);
-	if (!equalTupleDescs(tupdesc, reltupdesc))
-		ereport(ERROR,
-				(errcode(ERRCODE_DATATYPE_MISMATCH),
-				 errmsg("return type of %s must be same as row type of the relation",
-						"pglogical_table_data_filtered")));
+			state->row_filter_list = lappend(state->row_filter_list,
+											 exprstate);
+		}
 
-	/* Build the replication info for the table. */
-	replication_sets = textarray_to_list(rep_set_names);
-	replication_sets = get_replication_sets(node->node->id,
-											replication_sets,
-											false);
-	tableinfo = get_table_replication_info(node->node->id, rel,
-										   replication_sets);
+		/* Scan the table. */
+		state->scandesc = heap_beginscan(state->rel, GetActiveSnapshot(),
+										 0, NULL);
 
-	/* Prepare executor. */
-	estate = create_estate_for_relation(rel, false);
-	econtext = prepare_per_tuple_econtext(estate, reltupdesc);
+		RegisterExprContextCallback(rsi->econtext,
+									table_data_filtered_cleanup,
+									PointerGetDatum(state));
 
-	/* Prepare the row filter expression. */
-	foreach (lc, tableinfo->row_filter)
-	{
-		Node	   *row_filter = (Node *) lfirst(lc);
-		ExprState  *exprstate = pglogical_prepare_row_filter(row_filter);
+		funcctx->user_fctx = state;
 
-		row_filter_list = lappend(row_filter_list, exprstate);
+		MemoryContextSwitchTo(oldcontext);
 	}
 
+	funcctx = SRF_PERCALL_SETUP();
+	state = (TableDataFilteredState *) funcctx->user_fctx;
 
-	/* Scan the table. */
-	scandesc = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
-
-	while (HeapTupleIsValid(htup = heap_getnext(scandesc, ForwardScanDirection)))
+	while (HeapTupleIsValid(htup = heap_getnext(state->scandesc,
+												ForwardScanDirection)))
 	{
-		if (!filter_tuple(htup, econtext, row_filter_list))
-			continue;
+		bool		pass;
+
+		pass = filter_tuple(htup, state->econtext, state->row_filter_list);
+		ResetExprContext(state->econtext);
 
-		tuplestore_puttuple(tupstore, htup);
+		if (pass)
+			SRF_RETURN_NEXT(funcctx,
+							heap_copy_tuple_as_datum(htup, state->tupdesc));
 	}
 
 	/* Cleanup. */
-	ExecDropSingleTupleTableSlot(econtext->ecxt_scantuple);
-	FreeExecutorState(estate);
-
-	heap_endscan(scandesc);
-	heap_close(rel, NoLock);
+	UnregisterExprContextCallback(rsi->econtext,
+								  table_data_filtered_cleanup,
+								  PointerGetDatum(state));
+	table_data_filtered_cleanup(PointerGetDatum(state));
 
-	PG_RETURN_NULL();
+	SRF_RETURN_DONE(funcctx);
 }
 
 Datum
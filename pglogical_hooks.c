@@ -53,6 +53,9 @@ void pglogical_shutdown_hook(struct PGLogicalShutdownHookArgs *shutdown_args);
 bool pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args);
 bool pglogical_txn_filter_hook(struct PGLogicalTxnFilterArgs *txnfilter_args);
 
+static void prepare_row_filter_state(PGLogicalTableRepInfo *tblinfo,
+									 Relation rel);
+
 typedef struct PGLogicalHooksPrivate
 {
 	Oid			local_node_id;
@@ -281,18 +284,17 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 	}
 
 	/*
-	 * Proccess row filters.
-	 * XXX: we could probably cache some of the executor stuff.
+	 * Proccess row filters, the executor state is cached in tblinfo so that
+	 * only the evaluation happens for every row.
 	 */
 	if (list_length(tblinfo->row_filter) > 0)
 	{
-		EState		   *estate;
 		ExprContext	   *econtext;
-		TupleDesc		tupdesc = RelationGetDescr(rowfilter_args->changed_rel);
 		HeapTuple		oldtup = rowfilter_args->change->data.tp.oldtuple ?
 			&rowfilter_args->change->data.tp.oldtuple->tuple : NULL;
 		HeapTuple		newtup = rowfilter_args->change->data.tp.newtuple ?
 			&rowfilter_args->change->data.tp.newtuple->tuple : NULL;
+		bool			matched = true;
 
 		/* Skip empty changes. */
 		if (!newtup && !oldtup)
@@ -301,32 +303,36 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 			return false;
 		}
 
-		estate = create_estate_for_relation(rowfilter_args->changed_rel, false);
-		econtext = prepare_per_tuple_econtext(estate, tupdesc);
+		if (tblinfo->rf_estate == NULL)
+			prepare_row_filter_state(tblinfo, rowfilter_args->changed_rel);
+
+		econtext = tblinfo->rf_econtext;
 
 		ExecStoreTuple(newtup ? newtup : oldtup, econtext->ecxt_scantuple,
 					   InvalidBuffer, false);
 
 		/* Next try the row_filters if there are any. */
-		foreach (lc, tblinfo->row_filter)
+		foreach (lc, tblinfo->rf_exprstates)
 		{
-			Node	   *row_filter = (Node *) lfirst(lc);
-			ExprState  *exprstate = pglogical_prepare_row_filter(row_filter);
+			ExprState  *exprstate = (ExprState *) lfirst(lc);
 			Datum		res;
 			bool		isnull;
 
 			res = ExecEvalExpr(exprstate, econtext, &isnull, NULL);
 
 			/* NULL is same as false for our use. */
-			if (isnull)
-				return false;
-
-			if (!DatumGetBool(res))
-				return false;
+			if (isnull || !DatumGetBool(res))
+			{
+				matched = false;
+				break;
+			}
 		}
 
-		ExecDropSingleTupleTableSlot(econtext->ecxt_scantuple);
-		FreeExecutorState(estate);
+		ExecClearTuple(econtext->ecxt_scantuple);
+		ResetExprContext(econtext);
+
+		if (!matched)
+			return false;
 	}
 
 	/* Make sure caller is aware of any attribute filter. */
@@ -335,6 +341,44 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 	return true;
 }
 
+/*
+ * Build the executor state for evaluating the row filters of the table.
+ *
+ * The state lives in its own executor memory context under
+ * CacheMemoryContext, and uses a copy of the tuple descriptor so that the
+ * slot does not keep the relcache one pinned across transactions.
+ */
+static void
+prepare_row_filter_state(PGLogicalTableRepInfo *tblinfo, Relation rel)
+{
+	MemoryContext	oldctx;
+	EState		   *estate;
+	ExprContext	   *econtext;
+	List		   *exprstates = NIL;
+	ListCell	   *lc;
+
+	oldctx = MemoryContextSwitchTo(CacheMemoryContext);
+	estate = CreateExecutorState();
+	MemoryContextSwitchTo(estate->es_query_cxt);
+
+	econtext = prepare_per_tuple_econtext(estate,
+										  CreateTupleDescCopy(RelationGetDescr(rel)));
+
+	foreach (lc, tblinfo->row_filter)
+	{
+		Node	   *row_filter = (Node *) lfirst(lc);
+
+		exprstates = lappend(exprstates,
+							 pglogical_prepare_row_filter(row_filter));
+	}
+
+	MemoryContextSwitchTo(oldctx);
+
+	tblinfo->rf_econtext = econtext;
+	tblinfo->rf_exprstates = exprstates;
+	tblinfo->rf_estate = estate;
+}
+
 bool
 pglogical_txn_filter_hook(struct PGLogicalTxnFilterArgs *txnfilter_args)
 {
@@ -87,7 +87,7 @@ typedef struct SubscriptionTuple
 	NameData	sub_slot_name;
 } SubscriptionTuple;
 
-#define Natts_subscription			11
+#define Natts_subscription			13
 #define Anum_sub_id					1
 #define Anum_sub_name				2
 #define Anum_sub_origin				3
@@ -99,6 +99,8 @@ typedef struct SubscriptionTuple
 #define Anum_sub_replication_sets	9
 #define Anum_sub_forward_origins	10
 #define Anum_sub_apply_delay		11
+#define Anum_sub_coalesce_commits	12
+#define Anum_sub_compression		13
 
 /*
  * We impose same validation rules as replication slot name validation does.
@@ -738,6 +740,10 @@ create_subscription(PGLogicalSubscription *sub)
 	else
 		nulls[Anum_sub_apply_delay - 1] = true;
 
+	values[Anum_sub_coalesce_commits - 1] =
+		Int32GetDatum(sub->coalesce_commits);
+	values[Anum_sub_compression - 1] = BoolGetDatum(sub->compression);
+
 	tup = heap_form_tuple(tupDesc, values, nulls);
 
 	/* Insert the tuple to the catalog. */
@@ -824,6 +830,9 @@ alter_subscription(PGLogicalSubscription *sub)
 		nulls[Anum_sub_forward_origins - 1] = true;
 
 	values[Anum_sub_apply_delay - 1] = IntervalPGetDatum(sub->apply_delay);
+	values[Anum_sub_coalesce_commits - 1] =
+		Int32GetDatum(sub->coalesce_commits);
+	values[Anum_sub_compression - 1] = BoolGetDatum(sub->compression);
 
 	newtup = heap_modify_tuple(oldtup, tupDesc, values, nulls, replaces);
 
@@ -930,6 +939,20 @@ subscription_fromtuple(HeapTuple tuple, TupleDesc desc)
 	else
 		sub->apply_delay = DatumGetIntervalP(d);
 
+	/* Get coalesce_commits. */
+	d = heap_getattr(tuple, Anum_sub_coalesce_commits, desc, &isnull);
+	if (isnull)
+		sub->coalesce_commits = 0;
+	else
+		sub->coalesce_commits = DatumGetInt32(d);
+
+	/* Get compression. */
+	d = heap_getattr(tuple, Anum_sub_compression, desc, &isnull);
+	if (isnull)
+		sub->compression = false;
+	else
+		sub->compression = DatumGetBool(d);
+
 	return sub;
 }
 
@@ -43,6 +43,8 @@ typedef struct PGLogicalSubscription
 	PGlogicalInterface *target_if;
 	bool		enabled;
 	Interval   *apply_delay;
+	int			coalesce_commits;
+	bool		compression;
 	char	   *slot_name;
 	List	   *replication_sets;
 	List	   *forward_origins;
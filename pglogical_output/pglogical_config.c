@@ -65,7 +65,11 @@ enum {
 	PARAM_BINARY_BASETYPES_MAJOR_VERSION,
 	PARAM_PG_VERSION,
 	PARAM_HOOKS_SETUP_FUNCTION,
-	PARAM_NO_TXINFO
+	PARAM_NO_TXINFO,
+	PARAM_RELMETA_CACHE_SIZE,
+	PARAM_MESSAGE_BATCH_SIZE,
+	PARAM_COMPRESSION,
+	PARAM_COMPACT_ENCODING
 } OutputPluginParamKey;
 
 typedef struct {
@@ -92,6 +96,10 @@ static OutputPluginParam param_lookup[] = {
 	{"pg_version", PARAM_PG_VERSION},
 	{"hooks.setup_function", PARAM_HOOKS_SETUP_FUNCTION},
 	{"no_txinfo", PARAM_NO_TXINFO},
+	{"relmeta_cache_size", PARAM_RELMETA_CACHE_SIZE},
+	{"message_batch_size", PARAM_MESSAGE_BATCH_SIZE},
+	{"compression", PARAM_COMPRESSION},
+	{"compact_encoding", PARAM_COMPACT_ENCODING},
 	{NULL, PARAM_UNRECOGNISED}
 };
 
@@ -228,6 +236,33 @@ process_parameters_v1(List *options, PGLogicalOutputData *data)
 				data->client_no_txinfo = DatumGetBool(val);
 				break;
 
+			case PARAM_RELMETA_CACHE_SIZE:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_INT32);
+				data->client_relmeta_cache_size_set = true;
+				data->client_relmeta_cache_size = DatumGetInt32(val);
+				if (data->client_relmeta_cache_size < -1)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							 errmsg("relmeta_cache_size must be -1, 0 or a positive number of relations")));
+				break;
+
+			case PARAM_MESSAGE_BATCH_SIZE:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_UINT32);
+				data->client_message_batch_size_set = true;
+				data->client_message_batch_size = DatumGetUInt32(val);
+				break;
+
+			case PARAM_COMPRESSION:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_STRING);
+				data->client_compression = DatumGetCString(val);
+				break;
+
+			case PARAM_COMPACT_ENCODING:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_BOOL);
+				data->client_compact_encoding_set = true;
+				data->client_compact_encoding = DatumGetBool(val);
+				break;
+
 			case PARAM_UNRECOGNISED:
 				ereport(DEBUG1,
 						(errmsg("Unrecognised pglogical parameter %s ignored", elem->defname)));
@@ -482,6 +517,21 @@ prepare_startup_message(PGLogicalOutputData *data)
 
 	l = add_startup_msg_b(l, "no_txinfo", data->client_no_txinfo);
 
+	/* Only reported to clients which know about message batches. */
+	if (data->client_message_batch_size_set)
+		l = add_startup_msg_i(l, "message_batch_size",
+				data->message_batch_size);
+
+	/* Same for compression. */
+	if (data->client_compression != NULL)
+		l = add_startup_msg_s(l, "compression",
+				data->compress_state != NULL ? "zlib" : "none");
+
+	/* And for the compact encoding. */
+	if (data->client_compact_encoding_set)
+		l = add_startup_msg_b(l, "compact_encoding",
+				data->compact_encoding);
+
 
 	/*
 	 * Confirm that we've enabled any requested hook functions.
@@ -13,11 +13,20 @@
 #include "postgres.h"
 #include "pglogical_output.h"
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "libpq/pqformat.h"
 #include "mb/pg_wchar.h"
+#include "portability/instr_time.h"
 #include "replication/logical.h"
 #ifdef HAVE_REPLICATION_ORIGINS
 #include "replication/origin.h"
 #endif
+#include "replication/slot.h"
+#include "utils/guc.h"
+#include "utils/timestamp.h"
 
 #include "pglogical_config.h"
 #include "pglogical_output_internal.h"
@@ -47,9 +56,48 @@ static bool pg_decode_origin_filter(LogicalDecodingContext *ctx,
 
 static void send_startup_message(LogicalDecodingContext *ctx,
 		PGLogicalOutputData *data, bool last_message);
+static StringInfo begin_message(LogicalDecodingContext *ctx,
+		PGLogicalOutputData *data, bool last_write);
+static void end_message(LogicalDecodingContext *ctx,
+		PGLogicalOutputData *data, bool last_write);
+static void flush_message_batch(LogicalDecodingContext *ctx,
+		PGLogicalOutputData *data, bool last_write);
+static void compress_init(LogicalDecodingContext *ctx,
+		PGLogicalOutputData *data);
+static void compress_message(PGLogicalOutputData *data, StringInfo out,
+		int start);
+static void compress_append(PGLogicalOutputData *data, StringInfo out,
+		const char *src, int len);
+static void compress_report(LogicalDecodingContext *ctx,
+		PGLogicalOutputData *data, int elevel);
+static void compress_end(PGLogicalOutputData *data);
 
 static bool startup_message_sent = false;
 
+/* How often are the compression statistics logged while data is flowing */
+#define COMPRESS_REPORT_INTERVAL_MS		60000
+
+/*
+ * Compression of the native protocol stream.
+ *
+ * All messages following the startup message are compressed by one zlib
+ * stream which is flushed (but not reset) after every message, so the
+ * dictionary built from the previous messages is used for the following
+ * ones and even small rows compress well.
+ */
+typedef struct PGLCompressState
+{
+#ifdef HAVE_LIBZ
+	z_stream	zs;
+#endif
+	StringInfoData buf;			/* uncompressed copy of the message */
+	uint64		raw_bytes;
+	uint64		compressed_bytes;
+	instr_time	time;			/* time spent compressing */
+	TimestampTz	last_report;
+	uint64		last_report_bytes;	/* raw_bytes at last_report */
+} PGLCompressState;
+
 /* specify output plugin callbacks */
 void
 _PG_output_plugin_init(OutputPluginCallbacks *cb)
@@ -230,6 +278,31 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 				 	data->client_protocol_format)));
 		}
 
+		/*
+		 * Batch messages if the client can unpack the batches. Only the
+		 * native protocol supports it, the json protocol is meant to be
+		 * consumed one message at a time.
+		 */
+		if (data->client_message_batch_size > 0 &&
+			opt->output_type == OUTPUT_PLUGIN_BINARY_OUTPUT)
+		{
+			MemoryContext oldctx = MemoryContextSwitchTo(ctx->context);
+
+			data->message_batch_size = data->client_message_batch_size;
+			data->message_batch = makeStringInfo();
+
+			MemoryContextSwitchTo(oldctx);
+		}
+
+		/* Stream compression, only for the binary output as well. */
+		if (data->client_compression != NULL &&
+			opt->output_type == OUTPUT_PLUGIN_BINARY_OUTPUT)
+			compress_init(ctx, data);
+
+		/* Compact relation ids and lengths, native protocol only too. */
+		data->compact_encoding = data->client_compact_encoding &&
+			opt->output_type == OUTPUT_PLUGIN_BINARY_OUTPUT;
+
 		/* check for encoding match if specific encoding demanded by client */
 		if (data->client_expected_encoding != NULL
 				&& strlen(data->client_expected_encoding) != 0)
@@ -315,7 +388,10 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 			call_startup_hook(data, ctx->output_plugin_options);
 		}
 
-		pglogical_init_relmetacache(ctx->context);
+		/* Unless the client says otherwise it must cache all metadata. */
+		pglogical_init_relmetacache(ctx->context,
+									data->client_relmeta_cache_size_set ?
+									data->client_relmeta_cache_size : -1);
 	}
 }
 
@@ -327,6 +403,7 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 {
 	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
 	bool send_replication_origin = data->forward_changeset_origins;
+	StringInfo out;
 
 	if (!startup_message_sent)
 		send_startup_message(ctx, data, false /* can't be last message */);
@@ -336,8 +413,8 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 	send_replication_origin &= txn->origin_id != InvalidRepOriginId;
 #endif
 
-	OutputPluginPrepareWrite(ctx, !send_replication_origin);
-	data->api->write_begin(ctx->out, data, txn);
+	out = begin_message(ctx, data, !send_replication_origin);
+	data->api->write_begin(out, data, txn);
 
 #ifdef HAVE_REPLICATION_ORIGINS
 	if (send_replication_origin)
@@ -345,8 +422,8 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 		char *origin;
 
 		/* Message boundary */
-		OutputPluginWrite(ctx, false);
-		OutputPluginPrepareWrite(ctx, true);
+		end_message(ctx, data, false);
+		out = begin_message(ctx, data, true);
 
 		/*
 		 * XXX: which behaviour we want here?
@@ -359,11 +436,11 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 		 */
 		if (data->api->write_origin &&
 			replorigin_by_oid(txn->origin_id, true, &origin))
-			data->api->write_origin(ctx->out, origin, txn->origin_lsn);
+			data->api->write_origin(out, origin, txn->origin_lsn);
 	}
 #endif
 
-	OutputPluginWrite(ctx, true);
+	end_message(ctx, data, true);
 }
 
 /*
@@ -374,10 +451,22 @@ pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 					 XLogRecPtr commit_lsn)
 {
 	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
+	StringInfo out;
+
+	out = begin_message(ctx, data, true);
+	data->api->write_commit(out, data, txn, commit_lsn);
+	end_message(ctx, data, true);
+
+	/* Send the rest of the transaction. */
+	flush_message_batch(ctx, data, true);
 
-	OutputPluginPrepareWrite(ctx, true);
-	data->api->write_commit(ctx->out, data, txn, commit_lsn);
-	OutputPluginWrite(ctx, true);
+	if (data->compress_state != NULL &&
+		data->compress_state->raw_bytes !=
+			data->compress_state->last_report_bytes &&
+		TimestampDifferenceExceeds(data->compress_state->last_report,
+								   GetCurrentTimestamp(),
+								   COMPRESS_REPORT_INTERVAL_MS))
+		compress_report(ctx, data, LOG);
 
 	/*
 	 * Now is a good time to get rid of invalidated relation
@@ -395,7 +484,7 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	MemoryContext	old;
 	Bitmapset	   *att_filter;
 	struct PGLRelMetaCacheEntry *cached_relmeta = NULL;
-
+	StringInfo		out;
 
 	/* First check the table filter */
 	if (!call_row_filter_hook(data, txn, relation, change, &att_filter))
@@ -409,47 +498,52 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	 * isn't known to have metadata cached for this relation already,
 	 * send relation metadata.
 	 *
+	 * The cache entry is looked up even if the protocol doesn't send relation
+	 * metadata, the protocol may keep other per-relation information in it.
+	 *
 	 * TODO: track hit/miss stats
 	 */
-	if (data->api->write_rel != NULL &&
-			!pglogical_cache_relmeta(data, relation, &cached_relmeta))
+	if (!pglogical_cache_relmeta(data, relation, &cached_relmeta) &&
+		data->api->write_rel != NULL)
 	{
-		OutputPluginPrepareWrite(ctx, false);
-		data->api->write_rel(ctx->out, data, relation, cached_relmeta,
+		out = begin_message(ctx, data, false);
+		data->api->write_rel(out, data, relation, cached_relmeta,
 							 att_filter);
-		OutputPluginWrite(ctx, false);
+		end_message(ctx, data, false);
 	}
 
 	/* Send the data */
 	switch (change->action)
 	{
 		case REORDER_BUFFER_CHANGE_INSERT:
-			OutputPluginPrepareWrite(ctx, true);
-			data->api->write_insert(ctx->out, data, relation,
+			out = begin_message(ctx, data, true);
+			data->api->write_insert(out, data, relation, cached_relmeta,
 									&change->data.tp.newtuple->tuple,
 									att_filter);
-			OutputPluginWrite(ctx, true);
+			end_message(ctx, data, true);
 			break;
 		case REORDER_BUFFER_CHANGE_UPDATE:
 			{
 				HeapTuple oldtuple = change->data.tp.oldtuple ?
 					&change->data.tp.oldtuple->tuple : NULL;
 
-				OutputPluginPrepareWrite(ctx, true);
-				data->api->write_update(ctx->out, data, relation, oldtuple,
+				out = begin_message(ctx, data, true);
+				data->api->write_update(out, data, relation,
+										cached_relmeta, oldtuple,
 										&change->data.tp.newtuple->tuple,
 										att_filter);
-				OutputPluginWrite(ctx, true);
+				end_message(ctx, data, true);
 				break;
 			}
 		case REORDER_BUFFER_CHANGE_DELETE:
 			if (change->data.tp.oldtuple)
 			{
-				OutputPluginPrepareWrite(ctx, true);
-				data->api->write_delete(ctx->out, data, relation,
+				out = begin_message(ctx, data, true);
+				data->api->write_delete(out, data, relation,
+										cached_relmeta,
 										&change->data.tp.oldtuple->tuple,
 										att_filter);
-				OutputPluginWrite(ctx, true);
+				end_message(ctx, data, true);
 			}
 			else
 				elog(DEBUG1, "didn't send DELETE change because of missing oldtuple");
@@ -506,6 +600,251 @@ send_startup_message(LogicalDecodingContext *ctx,
 	startup_message_sent = true;
 }
 
+/*
+ * Start writing a protocol message, returns the buffer to write it to.
+ *
+ * Without batching this is just OutputPluginPrepareWrite(). With batching
+ * the message is appended to the current batch, prefixed by its length,
+ * and the batch starts with an 'M' message type byte.
+ */
+static StringInfo
+begin_message(LogicalDecodingContext *ctx, PGLogicalOutputData *data,
+			  bool last_write)
+{
+	StringInfo	batch = data->message_batch;
+
+	if (batch == NULL)
+	{
+		OutputPluginPrepareWrite(ctx, last_write);
+		data->message_start = ctx->out->len;
+		return ctx->out;
+	}
+
+	if (batch->len == 0)
+		pq_sendbyte(batch, 'M');
+
+	/* Placeholder for the message length, filled in by end_message(). */
+	data->message_batch_start = batch->len;
+	pq_sendint(batch, 0, 4);
+
+	return batch;
+}
+
+/*
+ * Finish the message started by begin_message().
+ *
+ * The batch is sent once it reaches the size requested by the client.
+ */
+static void
+end_message(LogicalDecodingContext *ctx, PGLogicalOutputData *data,
+			bool last_write)
+{
+	StringInfo	batch = data->message_batch;
+	uint32		len;
+	char	   *lenptr;
+
+	if (batch == NULL)
+	{
+		if (data->compress_state != NULL)
+			compress_message(data, ctx->out, data->message_start);
+		OutputPluginWrite(ctx, last_write);
+		return;
+	}
+
+	len = batch->len - data->message_batch_start - 4;
+	lenptr = batch->data + data->message_batch_start;
+	lenptr[0] = (len >> 24) & 0xFF;
+	lenptr[1] = (len >> 16) & 0xFF;
+	lenptr[2] = (len >> 8) & 0xFF;
+	lenptr[3] = len & 0xFF;
+
+	if (batch->len >= data->message_batch_size)
+		flush_message_batch(ctx, data, last_write);
+}
+
+/*
+ * Send the batched messages to the client, if any.
+ */
+static void
+flush_message_batch(LogicalDecodingContext *ctx, PGLogicalOutputData *data,
+					bool last_write)
+{
+	StringInfo	batch = data->message_batch;
+
+	if (batch == NULL || batch->len == 0)
+		return;
+
+	OutputPluginPrepareWrite(ctx, last_write);
+	if (data->compress_state != NULL)
+		compress_append(data, ctx->out, batch->data, batch->len);
+	else
+		appendBinaryStringInfo(ctx->out, batch->data, batch->len);
+	OutputPluginWrite(ctx, last_write);
+
+	/* Don't keep a huge buffer around after sending large rows. */
+	if (batch->maxlen > 2 * data->message_batch_size + BLCKSZ)
+	{
+		MemoryContext oldctx = MemoryContextSwitchTo(ctx->context);
+
+		pfree(batch->data);
+		initStringInfo(batch);
+		MemoryContextSwitchTo(oldctx);
+	}
+	else
+		resetStringInfo(batch);
+}
+
+/*
+ * Set up compression of the stream if the client asked for a method we
+ * support, otherwise the stream stays uncompressed.
+ */
+static void
+compress_init(LogicalDecodingContext *ctx, PGLogicalOutputData *data)
+{
+#ifdef HAVE_LIBZ
+	PGLCompressState *cs;
+	MemoryContext oldctx;
+
+	if (strcmp(data->client_compression, "zlib") != 0)
+	{
+		elog(DEBUG1, "unsupported compression method \"%s\" requested, not compressing",
+			 data->client_compression);
+		return;
+	}
+
+	oldctx = MemoryContextSwitchTo(ctx->context);
+
+	cs = palloc0(sizeof(PGLCompressState));
+	initStringInfo(&cs->buf);
+
+	/* We are mostly bandwidth bound but can't let the walsender be CPU bound. */
+	if (deflateInit(&cs->zs, Z_BEST_SPEED) != Z_OK)
+		elog(ERROR, "could not initialize compression: %s",
+			 cs->zs.msg ? cs->zs.msg : "unknown error");
+
+	cs->last_report = GetCurrentTimestamp();
+	data->compress_state = cs;
+
+	MemoryContextSwitchTo(oldctx);
+#else
+	elog(DEBUG1, "compression not supported by this build, not compressing");
+#endif
+}
+
+/*
+ * Replace the message starting at offset start of the output buffer by its
+ * compressed version.
+ */
+static void
+compress_message(PGLogicalOutputData *data, StringInfo out, int start)
+{
+	PGLCompressState *cs = data->compress_state;
+
+	resetStringInfo(&cs->buf);
+	appendBinaryStringInfo(&cs->buf, out->data + start, out->len - start);
+
+	out->len = start;
+	out->data[out->len] = '\0';
+
+	compress_append(data, out, cs->buf.data, cs->buf.len);
+}
+
+/*
+ * Append the compressed version of len bytes at src to out as 'Z' message.
+ *
+ * The compressed message consists of the message type byte, the length of
+ * the uncompressed data and the output of the compression stream up to a
+ * sync flush point, so the client can decompress it without waiting for
+ * any following data.
+ */
+static void
+compress_append(PGLogicalOutputData *data, StringInfo out,
+				const char *src, int len)
+{
+#ifdef HAVE_LIBZ
+	PGLCompressState *cs = data->compress_state;
+	int			start = out->len;
+	instr_time	starttime;
+	instr_time	endtime;
+
+	INSTR_TIME_SET_CURRENT(starttime);
+
+	pq_sendbyte(out, 'Z');
+	pq_sendint(out, len, 4);
+
+	cs->zs.next_in = (Bytef *) src;
+	cs->zs.avail_in = len;
+
+	for (;;)
+	{
+		int			avail;
+		int			rc;
+
+		enlargeStringInfo(out, deflateBound(&cs->zs, cs->zs.avail_in) + 16);
+		avail = out->maxlen - out->len - 1;
+
+		cs->zs.next_out = (Bytef *) (out->data + out->len);
+		cs->zs.avail_out = avail;
+
+		rc = deflate(&cs->zs, Z_SYNC_FLUSH);
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			elog(ERROR, "could not compress message: %s",
+				 cs->zs.msg ? cs->zs.msg : "unknown error");
+
+		out->len += avail - cs->zs.avail_out;
+
+		/* Everything was flushed if there was space left. */
+		if (cs->zs.avail_out != 0)
+			break;
+	}
+	out->data[out->len] = '\0';
+
+	INSTR_TIME_SET_CURRENT(endtime);
+	INSTR_TIME_ACCUM_DIFF(cs->time, endtime, starttime);
+
+	cs->raw_bytes += len;
+	cs->compressed_bytes += out->len - start;
+#else
+	Assert(false);
+#endif
+}
+
+/*
+ * Log how well the stream compresses and what it costs.
+ *
+ * The totals are since the start of the connection. The slot and the
+ * application name (the subscription's apply worker for pglogical) identify
+ * the connection, so the ratio can be judged for each subscription.
+ */
+static void
+compress_report(LogicalDecodingContext *ctx, PGLogicalOutputData *data,
+				int elevel)
+{
+	PGLCompressState *cs = data->compress_state;
+
+	ereport(elevel,
+			(errmsg("compressed " UINT64_FORMAT " bytes of logical replication data from slot \"%s\" to " UINT64_FORMAT " bytes (%.1f%%) using %.3f ms of CPU time",
+					cs->raw_bytes, NameStr(ctx->slot->data.name),
+					cs->compressed_bytes,
+					cs->raw_bytes > 0 ?
+					100.0 * cs->compressed_bytes / cs->raw_bytes : 100.0,
+					INSTR_TIME_GET_MILLISEC(cs->time)),
+			 errdetail("Client application name is \"%s\".",
+					   application_name ? application_name : "")));
+
+	cs->last_report = GetCurrentTimestamp();
+	cs->last_report_bytes = cs->raw_bytes;
+}
+
+static void
+compress_end(PGLogicalOutputData *data)
+{
+#ifdef HAVE_LIBZ
+	deflateEnd(&data->compress_state->zs);
+#endif
+	data->compress_state = NULL;
+}
+
 static void pg_decode_shutdown(LogicalDecodingContext * ctx)
 {
 	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
@@ -514,6 +853,12 @@ static void pg_decode_shutdown(LogicalDecodingContext * ctx)
 
 	pglogical_destroy_relmetacache();
 
+	if (data->compress_state != NULL)
+	{
+		compress_report(ctx, data, LOG);
+		compress_end(data);
+	}
+
 	/*
 	 * no need to delete data->context or data->hooks_session_mctxt as they're
 	 * children of ctx->context which will expire on return.
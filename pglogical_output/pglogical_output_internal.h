@@ -31,6 +31,28 @@ struct PGLogicalOutputData
 	bool		forward_changeset_origins;
 	int			field_datum_encoding;
 
+	/*
+	 * Protocol messages are collected in message_batch and sent together
+	 * once the batch reaches message_batch_size bytes or at commit. Batching
+	 * is disabled when message_batch is NULL.
+	 */
+	uint32		message_batch_size;
+	StringInfo	message_batch;
+	int			message_batch_start;
+
+	/*
+	 * Stream compression state (NULL if disabled), message_start is the
+	 * offset of the message being written in the output buffer.
+	 */
+	struct PGLCompressState *compress_state;
+	int			message_start;
+
+	/*
+	 * Reference relations by the small ids assigned in the relmeta cache and
+	 * send variable length integers instead of fixed 4-byte lengths.
+	 */
+	bool		compact_encoding;
+
 	/*
 	 * client info
 	 *
@@ -60,6 +82,13 @@ struct PGLogicalOutputData
 	bool		client_binary_intdatetimes_set;
 	bool		client_binary_intdatetimes;
 	bool		client_no_txinfo;
+	bool		client_relmeta_cache_size_set;
+	int32		client_relmeta_cache_size;
+	bool		client_message_batch_size_set;
+	uint32		client_message_batch_size;
+	const char *client_compression;
+	bool		client_compact_encoding_set;
+	bool		client_compact_encoding;
 
 	/* hooks */
 	List	   *hooks_setup_funcname;
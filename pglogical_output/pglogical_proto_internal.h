@@ -34,14 +34,17 @@ typedef void (*pglogical_write_origin_fn) (StringInfo out, const char *origin,
 													   XLogRecPtr origin_lsn);
 
 typedef void (*pglogical_write_insert_fn) (StringInfo out, PGLogicalOutputData * data,
-										   Relation rel, HeapTuple newtuple,
+										   Relation rel, PGLRelMetaCacheEntry * cache_entry,
+										   HeapTuple newtuple,
 										   Bitmapset *att_filter);
 typedef void (*pglogical_write_update_fn) (StringInfo out, PGLogicalOutputData * data,
-											Relation rel, HeapTuple oldtuple,
+											Relation rel, PGLRelMetaCacheEntry * cache_entry,
+											HeapTuple oldtuple,
 											HeapTuple newtuple,
 											Bitmapset *att_filter);
 typedef void (*pglogical_write_delete_fn) (StringInfo out, PGLogicalOutputData * data,
-										   Relation rel, HeapTuple oldtuple,
+										   Relation rel, PGLRelMetaCacheEntry * cache_entry,
+										   HeapTuple oldtuple,
 										   Bitmapset *att_filter);
 
 typedef void (*write_startup_message_fn) (StringInfo out, List *msg);
@@ -13,7 +13,9 @@
 #include "postgres.h"
 #include "pglogical_output.h"
 
+#include "access/htup_details.h"
 #include "access/sysattr.h"
+#include "access/transam.h"
 #include "access/tuptoaster.h"
 #include "catalog/index.h"
 #include "catalog/namespace.h"
@@ -91,20 +93,204 @@ pglogical_json_write_commit(StringInfo out, PGLogicalOutputData *data, ReorderBu
 }
 
 /*
- * Write a tuple to the outputstream, in the most efficient format possible.
+ * How the direct JSON encoder writes values of a column. The output is the
+ * same as that of row_to_json.
+ */
+#define JSON_KIND_BOOL		'b'		/* true or false */
+#define JSON_KIND_NUMERIC	'n'		/* bare number unless NaN or Infinity */
+#define JSON_KIND_JSON		'j'		/* output function result as is */
+#define JSON_KIND_TEXT		't'		/* escaped output function result */
+
+/*
+ * Decide how to write values of the given type, returns false for types
+ * that row_to_json formats in a special way (arrays, composites, datetime
+ * types and user defined types which may have a cast to json).
+ */
+static bool
+json_column_kind(Oid typid, char *kind)
+{
+	Oid			basetypid = getBaseType(typid);
+
+	if (basetypid >= FirstNormalObjectId ||
+		OidIsValid(get_element_type(basetypid)) ||
+		type_is_rowtype(basetypid))
+		return false;
+
+	switch (basetypid)
+	{
+		case BOOLOID:
+			*kind = JSON_KIND_BOOL;
+			break;
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+			*kind = JSON_KIND_NUMERIC;
+			break;
+		case JSONOID:
+		case JSONBOID:
+			*kind = JSON_KIND_JSON;
+			break;
+		case DATEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return false;
+		default:
+			*kind = JSON_KIND_TEXT;
+			break;
+	}
+
+	return true;
+}
+
+/*
+ * Build the per-relation information the JSON writer needs: the escaped
+ * relation name and column keys and the output function of every column.
+ */
+static void
+json_build_plan(Relation rel, PGLRelMetaCacheEntry *cache_entry)
+{
+	TupleDesc	desc = RelationGetDescr(rel);
+	MemoryContext oldctx;
+	StringInfoData buf;
+	int			i;
+
+	MemoryContextReset(cache_entry->plan_context);
+
+	/* Don't leave half-built plan behind on error. */
+	cache_entry->plan_valid = false;
+
+	oldctx = MemoryContextSwitchTo(cache_entry->plan_context);
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, "\"relation\":[");
+	escape_json(&buf, get_namespace_name(RelationGetNamespace(rel)));
+	appendStringInfoChar(&buf, ',');
+	escape_json(&buf, RelationGetRelationName(rel));
+	appendStringInfoChar(&buf, ']');
+	cache_entry->json_relation = buf.data;
+
+	cache_entry->json_use_row_to_json = false;
+	cache_entry->nliveatts = 0;
+	cache_entry->liveatts = (PGLRelMetaColumn *)
+		palloc(Max(desc->natts, 1) * sizeof(PGLRelMetaColumn));
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute att = desc->attrs[i];
+		PGLRelMetaColumn *col;
+		Oid			typoutput;
+		bool		typisvarlena;
+
+		if (att->attisdropped)
+			continue;
+
+		col = &cache_entry->liveatts[cache_entry->nliveatts++];
+		col->attno = i;
+		col->attlen = att->attlen;
+		col->attbyval = att->attbyval;
+		col->transfer_type = 't';
+
+		if (!json_column_kind(att->atttypid, &col->json_kind))
+		{
+			cache_entry->json_use_row_to_json = true;
+			break;
+		}
+
+		initStringInfo(&buf);
+		escape_json(&buf, NameStr(att->attname));
+		appendStringInfoChar(&buf, ':');
+		col->json_key = buf.data;
+
+		getTypeOutputInfo(att->atttypid, &typoutput, &typisvarlena);
+		fmgr_info_cxt(typoutput, &col->finfo, cache_entry->plan_context);
+	}
+
+	cache_entry->deform_natts = desc->natts;
+	cache_entry->values = (Datum *) palloc(Max(desc->natts, 1) * sizeof(Datum));
+	cache_entry->isnull = (bool *) palloc(Max(desc->natts, 1) * sizeof(bool));
+
+	MemoryContextSwitchTo(oldctx);
+
+	cache_entry->plan_valid = true;
+}
+
+/*
+ * Write a tuple to the outputstream as json object.
+ *
+ * The values are written directly to the output buffer, only relations
+ * with column types for which row_to_json has special formatting rules go
+ * through row_to_json.
  */
 static void
-json_write_tuple(StringInfo out, Relation rel, HeapTuple tuple)
+json_write_tuple(StringInfo out, Relation rel,
+				 PGLRelMetaCacheEntry *cache_entry, HeapTuple tuple)
 {
-	TupleDesc	desc;
-	Datum		tupdatum,
-				json;
+	TupleDesc	desc = RelationGetDescr(rel);
+	int			j;
+
+	if (cache_entry->json_use_row_to_json)
+	{
+		Datum		tupdatum,
+					json;
+
+		tupdatum = heap_copy_tuple_as_datum(tuple, desc);
+		json = DirectFunctionCall1(row_to_json, tupdatum);
+
+		appendStringInfoString(out, TextDatumGetCString(json));
+		return;
+	}
+
+	heap_deform_tuple(tuple, desc, cache_entry->values, cache_entry->isnull);
 
-	desc = RelationGetDescr(rel);
-	tupdatum = heap_copy_tuple_as_datum(tuple, desc);
-	json = DirectFunctionCall1(row_to_json, tupdatum);
+	appendStringInfoChar(out, '{');
+	for (j = 0; j < cache_entry->nliveatts; j++)
+	{
+		PGLRelMetaColumn *col = &cache_entry->liveatts[j];
+		Datum		value = cache_entry->values[col->attno];
+		char	   *outputstr;
+
+		if (j > 0)
+			appendStringInfoChar(out, ',');
+		appendStringInfoString(out, col->json_key);
 
-	appendStringInfoString(out, TextDatumGetCString(json));
+		if (cache_entry->isnull[col->attno])
+		{
+			appendStringInfoString(out, "null");
+			continue;
+		}
+
+		switch (col->json_kind)
+		{
+			case JSON_KIND_BOOL:
+				appendStringInfoString(out,
+									   DatumGetBool(value) ? "true" : "false");
+				break;
+			case JSON_KIND_NUMERIC:
+				outputstr = OutputFunctionCall(&col->finfo, value);
+				/* NaN and infinities aren't valid JSON numbers. */
+				if (outputstr[0] == 'N' || outputstr[0] == 'I' ||
+					(outputstr[0] == '-' && outputstr[1] == 'I'))
+					escape_json(out, outputstr);
+				else
+					appendStringInfoString(out, outputstr);
+				pfree(outputstr);
+				break;
+			case JSON_KIND_JSON:
+				outputstr = OutputFunctionCall(&col->finfo, value);
+				appendStringInfoString(out, outputstr);
+				pfree(outputstr);
+				break;
+			default:
+				outputstr = OutputFunctionCall(&col->finfo, value);
+				escape_json(out, outputstr);
+				pfree(outputstr);
+				break;
+		}
+	}
+	appendStringInfoChar(out, '}');
 }
 
 /*
@@ -114,23 +300,24 @@ json_write_tuple(StringInfo out, Relation rel, HeapTuple tuple)
  */
 static void
 pglogical_json_write_change(StringInfo out, const char *change, Relation rel,
+							PGLRelMetaCacheEntry *cache_entry,
 							HeapTuple oldtuple, HeapTuple newtuple)
 {
-	appendStringInfoChar(out, '{');
-	appendStringInfo(out, "\"action\":\"%s\",\"relation\":[\"%s\",\"%s\"]",
-					 change,
-					 get_namespace_name(RelationGetNamespace(rel)),
-					 RelationGetRelationName(rel));
+	if (!cache_entry->plan_valid)
+		json_build_plan(rel, cache_entry);
+
+	appendStringInfo(out, "{\"action\":\"%s\",", change);
+	appendStringInfoString(out, cache_entry->json_relation);
 
 	if (oldtuple)
 	{
 		appendStringInfoString(out, ",\"oldtuple\":");
-		json_write_tuple(out, rel, oldtuple);
+		json_write_tuple(out, rel, cache_entry, oldtuple);
 	}
 	if (newtuple)
 	{
 		appendStringInfoString(out, ",\"newtuple\":");
-		json_write_tuple(out, rel, newtuple);
+		json_write_tuple(out, rel, cache_entry, newtuple);
 	}
 	appendStringInfoChar(out, '}');
 }
@@ -140,10 +327,10 @@ pglogical_json_write_change(StringInfo out, const char *change, Relation rel,
  */
 void
 pglogical_json_write_insert(StringInfo out, PGLogicalOutputData *data,
-							Relation rel, HeapTuple newtuple,
-							Bitmapset *att_filter)
+							Relation rel, PGLRelMetaCacheEntry *cache_entry,
+							HeapTuple newtuple, Bitmapset *att_filter)
 {
-	pglogical_json_write_change(out, "I", rel, NULL, newtuple);
+	pglogical_json_write_change(out, "I", rel, cache_entry, NULL, newtuple);
 }
 
 /*
@@ -151,10 +338,12 @@ pglogical_json_write_insert(StringInfo out, PGLogicalOutputData *data,
  */
 void
 pglogical_json_write_update(StringInfo out, PGLogicalOutputData *data,
-							Relation rel, HeapTuple oldtuple,
-							HeapTuple newtuple, Bitmapset *att_filter)
+							Relation rel, PGLRelMetaCacheEntry *cache_entry,
+							HeapTuple oldtuple, HeapTuple newtuple,
+							Bitmapset *att_filter)
 {
-	pglogical_json_write_change(out, "U", rel, oldtuple, newtuple);
+	pglogical_json_write_change(out, "U", rel, cache_entry, oldtuple,
+								newtuple);
 }
 
 /*
@@ -162,10 +351,10 @@ pglogical_json_write_update(StringInfo out, PGLogicalOutputData *data,
  */
 void
 pglogical_json_write_delete(StringInfo out, PGLogicalOutputData *data,
-							Relation rel, HeapTuple oldtuple,
-							Bitmapset *att_filter)
+							Relation rel, PGLRelMetaCacheEntry *cache_entry,
+							HeapTuple oldtuple, Bitmapset *att_filter)
 {
-	pglogical_json_write_change(out, "D", rel, oldtuple, NULL);
+	pglogical_json_write_change(out, "D", rel, cache_entry, oldtuple, NULL);
 }
 
 /*
@@ -13,6 +13,7 @@
 #include "postgres.h"
 #include "pglogical_output.h"
 
+#include "access/htup_details.h"
 #include "access/sysattr.h"
 #include "access/tuptoaster.h"
 #include "catalog/pg_type.h"
@@ -28,11 +29,27 @@
 
 #define IS_REPLICA_IDENTITY 1
 
+/* Message flag: relation id and field lengths are variable length ints */
+#define COMPACT_ENCODING 1
+
 static void pglogical_write_attrs(StringInfo out, Relation rel,
 								  Bitmapset *att_filter);
 static void pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
-								  Relation rel, HeapTuple tuple,
-								  Bitmapset *att_filter);
+								  Relation rel,
+								  PGLRelMetaCacheEntry *cache_entry,
+								  HeapTuple tuple, Bitmapset *att_filter);
+static void pglogical_write_relid(StringInfo out, PGLogicalOutputData *data,
+								  Relation rel,
+								  PGLRelMetaCacheEntry *cache_entry);
+static void pglogical_write_length(StringInfo out, PGLogicalOutputData *data,
+								   uint32 len);
+static void pglogical_send_varint(StringInfo out, uint32 val);
+static void pglogical_deform_tuple(HeapTuple tuple, TupleDesc desc,
+								   int natts, Datum *values, bool *isnull);
+static void pglogical_build_send_plan(PGLogicalOutputData *data,
+									  Relation rel,
+									  PGLRelMetaCacheEntry *cache_entry,
+									  Bitmapset *att_filter);
 static char decide_datum_transfer(Form_pg_attribute att,
 								  Form_pg_type typclass,
 								  bool allow_internal_basetypes,
@@ -59,8 +76,17 @@ pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel,
 	/* send the flags field */
 	pq_sendbyte(out, flags);
 
-	/* use Oid as relation identifier */
-	pq_sendint(out, RelationGetRelid(rel), 4);
+	/*
+	 * Use Oid as relation identifier, or the compact id which the following
+	 * changes of the relation will reference.
+	 */
+	if (data->compact_encoding)
+	{
+		Assert(cache_entry != NULL);
+		pq_sendint(out, cache_entry->compact_id, 4);
+	}
+	else
+		pq_sendint(out, RelationGetRelid(rel), 4);
 
 	nspname = get_namespace_name(rel->rd_rel->relnamespace);
 	if (nspname == NULL)
@@ -231,21 +257,23 @@ pglogical_write_origin(StringInfo out, const char *origin,
  */
 void
 pglogical_write_insert(StringInfo out, PGLogicalOutputData *data,
-						Relation rel, HeapTuple newtuple,
-						Bitmapset *att_filter)
+						Relation rel, PGLRelMetaCacheEntry *cache_entry,
+						HeapTuple newtuple, Bitmapset *att_filter)
 {
 	uint8 flags = 0;
 
 	pq_sendbyte(out, 'I');		/* action INSERT */
 
+	if (data->compact_encoding)
+		flags |= COMPACT_ENCODING;
+
 	/* send the flags field */
 	pq_sendbyte(out, flags);
 
-	/* use Oid as relation identifier */
-	pq_sendint(out, RelationGetRelid(rel), 4);
+	pglogical_write_relid(out, data, rel, cache_entry);
 
 	pq_sendbyte(out, 'N');		/* new tuple follows */
-	pglogical_write_tuple(out, data, rel, newtuple, att_filter);
+	pglogical_write_tuple(out, data, rel, cache_entry, newtuple, att_filter);
 }
 
 /*
@@ -253,18 +281,21 @@ pglogical_write_insert(StringInfo out, PGLogicalOutputData *data,
  */
 void
 pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
-						Relation rel, HeapTuple oldtuple, HeapTuple newtuple,
+						Relation rel, PGLRelMetaCacheEntry *cache_entry,
+						HeapTuple oldtuple, HeapTuple newtuple,
 						Bitmapset *att_filter)
 {
 	uint8 flags = 0;
 
 	pq_sendbyte(out, 'U');		/* action UPDATE */
 
+	if (data->compact_encoding)
+		flags |= COMPACT_ENCODING;
+
 	/* send the flags field */
 	pq_sendbyte(out, flags);
 
-	/* use Oid as relation identifier */
-	pq_sendint(out, RelationGetRelid(rel), 4);
+	pglogical_write_relid(out, data, rel, cache_entry);
 
 	/*
 	 * TODO: support whole tuple (O tuple type)
@@ -279,11 +310,12 @@ pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
 	if (oldtuple != NULL)
 	{
 		pq_sendbyte(out, 'K');	/* old key follows */
-		pglogical_write_tuple(out, data, rel, oldtuple, att_filter);
+		pglogical_write_tuple(out, data, rel, cache_entry, oldtuple,
+							  att_filter);
 	}
 
 	pq_sendbyte(out, 'N');		/* new tuple follows */
-	pglogical_write_tuple(out, data, rel, newtuple, att_filter);
+	pglogical_write_tuple(out, data, rel, cache_entry, newtuple, att_filter);
 }
 
 /*
@@ -291,18 +323,20 @@ pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
  */
 void
 pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
-						Relation rel, HeapTuple oldtuple,
-						Bitmapset *att_filter)
+						Relation rel, PGLRelMetaCacheEntry *cache_entry,
+						HeapTuple oldtuple, Bitmapset *att_filter)
 {
 	uint8 flags = 0;
 
 	pq_sendbyte(out, 'D');		/* action DELETE */
 
+	if (data->compact_encoding)
+		flags |= COMPACT_ENCODING;
+
 	/* send the flags field */
 	pq_sendbyte(out, flags);
 
-	/* use Oid as relation identifier */
-	pq_sendint(out, RelationGetRelid(rel), 4);
+	pglogical_write_relid(out, data, rel, cache_entry);
 
 	/*
 	 * TODO support whole tuple ('O' tuple type)
@@ -310,7 +344,7 @@ pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
 	 * See notes on update for details
 	 */
 	pq_sendbyte(out, 'K');	/* old key follows */
-	pglogical_write_tuple(out, data, rel, oldtuple, att_filter);
+	pglogical_write_tuple(out, data, rel, cache_entry, oldtuple, att_filter);
 }
 
 /*
@@ -335,25 +369,38 @@ write_startup_message(StringInfo out, List *msg)
 }
 
 /*
- * Write a tuple to the outputstream, in the most efficient format possible.
+ * Build the plan for sending tuples of the relation: the list of columns
+ * which pass the att_filter, the transfer type of each of them and the send
+ * or output function to use. This way we don't have to consult the type
+ * cache for every column of every row.
  */
 static void
-pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
-					  Relation rel, HeapTuple tuple, Bitmapset *att_filter)
+pglogical_build_send_plan(PGLogicalOutputData *data, Relation rel,
+						  PGLRelMetaCacheEntry *cache_entry,
+						  Bitmapset *att_filter)
 {
-	TupleDesc	desc;
-	Datum		values[MaxTupleAttributeNumber];
-	bool		isnull[MaxTupleAttributeNumber];
+	TupleDesc	desc = RelationGetDescr(rel);
+	MemoryContext oldctx;
 	int			i;
-	uint16		nliveatts = 0;
 
-	desc = RelationGetDescr(rel);
+	MemoryContextReset(cache_entry->plan_context);
 
-	pq_sendbyte(out, 'T');			/* sending TUPLE */
+	/* Don't leave half-built plan behind on error. */
+	cache_entry->plan_valid = false;
+
+	oldctx = MemoryContextSwitchTo(cache_entry->plan_context);
+
+	cache_entry->plan_att_filter = bms_copy(att_filter);
+	cache_entry->nliveatts = 0;
+	cache_entry->liveatts = (PGLRelMetaColumn *)
+		palloc(Max(desc->natts, 1) * sizeof(PGLRelMetaColumn));
 
 	for (i = 0; i < desc->natts; i++)
 	{
 		Form_pg_attribute att = desc->attrs[i];
+		PGLRelMetaColumn *col;
+		HeapTuple	typtup;
+		Form_pg_type typclass;
 
 		if (att->attisdropped)
 			continue;
@@ -361,98 +408,139 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 			!bms_is_member(att->attnum - FirstLowInvalidHeapAttributeNumber,
 						   att_filter))
 			continue;
-		nliveatts++;
+
+		col = &cache_entry->liveatts[cache_entry->nliveatts++];
+		col->attno = i;
+		col->attlen = att->attlen;
+		col->attbyval = att->attbyval;
+
+		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
+		if (!HeapTupleIsValid(typtup))
+			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
+		typclass = (Form_pg_type) GETSTRUCT(typtup);
+
+		col->transfer_type = decide_datum_transfer(att, typclass,
+												   data->allow_internal_basetypes,
+												   data->allow_binary_basetypes);
+
+		if (col->transfer_type == 'b')
+			fmgr_info_cxt(typclass->typsend, &col->finfo,
+						  cache_entry->plan_context);
+		else if (col->transfer_type == 't')
+			fmgr_info_cxt(typclass->typoutput, &col->finfo,
+						  cache_entry->plan_context);
+
+		ReleaseSysCache(typtup);
 	}
-	pq_sendint(out, nliveatts, 2);
+
+	/* We only need to deform the tuple up to the last column we send. */
+	if (cache_entry->nliveatts > 0)
+		cache_entry->deform_natts =
+			cache_entry->liveatts[cache_entry->nliveatts - 1].attno + 1;
+	else
+		cache_entry->deform_natts = 0;
+	cache_entry->values = (Datum *)
+		palloc(Max(cache_entry->deform_natts, 1) * sizeof(Datum));
+	cache_entry->isnull = (bool *)
+		palloc(Max(cache_entry->deform_natts, 1) * sizeof(bool));
+
+	MemoryContextSwitchTo(oldctx);
+
+	cache_entry->plan_valid = true;
+}
+
+/*
+ * Write a tuple to the outputstream, in the most efficient format possible.
+ */
+static void
+pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
+					  Relation rel, PGLRelMetaCacheEntry *cache_entry,
+					  HeapTuple tuple, Bitmapset *att_filter)
+{
+	TupleDesc	desc;
+	Datum	   *values;
+	bool	   *isnull;
+	int			j;
+
+	Assert(cache_entry != NULL);
+
+	if (!cache_entry->plan_valid ||
+		!bms_equal(cache_entry->plan_att_filter, att_filter))
+		pglogical_build_send_plan(data, rel, cache_entry, att_filter);
+
+	desc = RelationGetDescr(rel);
+
+	pq_sendbyte(out, 'T');			/* sending TUPLE */
+
+	pq_sendint(out, cache_entry->nliveatts, 2);
 
 	/* try to allocate enough memory from the get go */
 	enlargeStringInfo(out, tuple->t_len +
-					  nliveatts * (1 + 4));
+					  cache_entry->nliveatts * (1 + 4));
 
-	/*
-	 * XXX: should this prove to be a relevant bottleneck, it might be
-	 * interesting to inline heap_deform_tuple() here, we don't actually need
-	 * the information in the form we get from it.
-	 */
-	heap_deform_tuple(tuple, desc, values, isnull);
+	values = cache_entry->values;
+	isnull = cache_entry->isnull;
+	pglogical_deform_tuple(tuple, desc, cache_entry->deform_natts,
+						   values, isnull);
 
-	for (i = 0; i < desc->natts; i++)
+	for (j = 0; j < cache_entry->nliveatts; j++)
 	{
-		HeapTuple	typtup;
-		Form_pg_type typclass;
-		Form_pg_attribute att = desc->attrs[i];
-		char		transfer_type;
-
-		/* skip dropped columns */
-		if (att->attisdropped)
-			continue;
-		if (att_filter &&
-			!bms_is_member(att->attnum - FirstLowInvalidHeapAttributeNumber,
-						   att_filter))
-			continue;
+		PGLRelMetaColumn *col = &cache_entry->liveatts[j];
+		int			i = col->attno;
 
 		if (isnull[i])
 		{
 			pq_sendbyte(out, 'n');	/* null column */
 			continue;
 		}
-		else if (att->attlen == -1 && VARATT_IS_EXTERNAL_ONDISK(values[i]))
+		else if (col->attlen == -1 && VARATT_IS_EXTERNAL_ONDISK(values[i]))
 		{
 			pq_sendbyte(out, 'u');	/* unchanged toast column */
 			continue;
 		}
 
-		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
-		if (!HeapTupleIsValid(typtup))
-			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
-		typclass = (Form_pg_type) GETSTRUCT(typtup);
-
-		transfer_type = decide_datum_transfer(att, typclass,
-											  data->allow_internal_basetypes,
-											  data->allow_binary_basetypes);
-
-		switch (transfer_type)
+		switch (col->transfer_type)
 		{
 			case 'i':
 				pq_sendbyte(out, 'i');	/* internal-format binary data follows */
 
 				/* pass by value */
-				if (att->attbyval)
+				if (col->attbyval)
 				{
-					pq_sendint(out, att->attlen, 4); /* length */
+					pglogical_write_length(out, data, col->attlen);
 
-					enlargeStringInfo(out, att->attlen);
+					enlargeStringInfo(out, col->attlen);
 					store_att_byval(out->data + out->len, values[i],
-									att->attlen);
-					out->len += att->attlen;
+									col->attlen);
+					out->len += col->attlen;
 					out->data[out->len] = '\0';
 				}
 				/* fixed length non-varlena pass-by-reference type */
-				else if (att->attlen > 0)
+				else if (col->attlen > 0)
 				{
-					pq_sendint(out, att->attlen, 4); /* length */
+					pglogical_write_length(out, data, col->attlen);
 
 					appendBinaryStringInfo(out, DatumGetPointer(values[i]),
-										   att->attlen);
+										   col->attlen);
 				}
 				/* varlena type */
-				else if (att->attlen == -1)
+				else if (col->attlen == -1)
 				{
-					char *data = DatumGetPointer(values[i]);
+					char *val = DatumGetPointer(values[i]);
 
 					/* send indirect datums inline */
 					if (VARATT_IS_EXTERNAL_INDIRECT(values[i]))
 					{
 						struct varatt_indirect redirect;
-						VARATT_EXTERNAL_GET_POINTER(redirect, data);
-						data = (char *) redirect.pointer;
+						VARATT_EXTERNAL_GET_POINTER(redirect, val);
+						val = (char *) redirect.pointer;
 					}
 
-					Assert(!VARATT_IS_EXTERNAL(data));
+					Assert(!VARATT_IS_EXTERNAL(val));
 
-					pq_sendint(out, VARSIZE_ANY(data), 4); /* length */
+					pglogical_write_length(out, data, VARSIZE_ANY(val));
 
-					appendBinaryStringInfo(out, data, VARSIZE_ANY(data));
+					appendBinaryStringInfo(out, val, VARSIZE_ANY(val));
 				}
 				else
 					elog(ERROR, "unsupported tuple type");
@@ -466,11 +554,10 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 
 					pq_sendbyte(out, 'b');	/* binary send/recv data follows */
 
-					outputbytes = OidSendFunctionCall(typclass->typsend,
-													  values[i]);
+					outputbytes = SendFunctionCall(&col->finfo, values[i]);
 
 					len = VARSIZE(outputbytes) - VARHDRSZ;
-					pq_sendint(out, len, 4); /* length */
+					pglogical_write_length(out, data, len);
 					pq_sendbytes(out, VARDATA(outputbytes), len); /* data */
 					pfree(outputbytes);
 				}
@@ -483,16 +570,158 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 
 					pq_sendbyte(out, 't');	/* 'text' data follows */
 
-					outputstr =	OidOutputFunctionCall(typclass->typoutput,
-													  values[i]);
+					outputstr =	OutputFunctionCall(&col->finfo, values[i]);
 					len = strlen(outputstr) + 1;
-					pq_sendint(out, len, 4); /* length */
+					pglogical_write_length(out, data, len);
 					appendBinaryStringInfo(out, outputstr, len); /* data */
 					pfree(outputstr);
 				}
 		}
+	}
+}
 
-		ReleaseSysCache(typtup);
+/*
+ * Write the identifier of the relation a change belongs to.
+ *
+ * With the compact encoding that's the id assigned by the relmeta cache,
+ * which is small enough to mostly fit in one or two bytes.
+ */
+static void
+pglogical_write_relid(StringInfo out, PGLogicalOutputData *data,
+					  Relation rel, PGLRelMetaCacheEntry *cache_entry)
+{
+	if (data->compact_encoding)
+	{
+		Assert(cache_entry != NULL);
+		pglogical_send_varint(out, cache_entry->compact_id);
+	}
+	else
+		pq_sendint(out, RelationGetRelid(rel), 4); /* use Oid as relation identifier */
+}
+
+/*
+ * Write the length of a column value.
+ */
+static void
+pglogical_write_length(StringInfo out, PGLogicalOutputData *data, uint32 len)
+{
+	if (data->compact_encoding)
+		pglogical_send_varint(out, len);
+	else
+		pq_sendint(out, len, 4);
+}
+
+/*
+ * Write an unsigned integer in 7 bit groups, least significant group first,
+ * with the high bit set on every byte but the last one. That takes between
+ * one (values below 128) and five bytes.
+ */
+static void
+pglogical_send_varint(StringInfo out, uint32 val)
+{
+	char		buf[5];
+	int			len = 0;
+
+	do
+	{
+		uint8		b = val & 0x7F;
+
+		val >>= 7;
+		if (val != 0)
+			b |= 0x80;
+		buf[len++] = b;
+	} while (val != 0);
+
+	appendBinaryStringInfo(out, buf, len);
+}
+
+/*
+ * Same as heap_deform_tuple() but only extracts the first natts attributes.
+ *
+ * When the attribute filter only lets through some leading columns of a wide
+ * table there is no point in walking the rest of the tuple.
+ */
+static void
+pglogical_deform_tuple(HeapTuple tuple, TupleDesc desc, int natts,
+					   Datum *values, bool *isnull)
+{
+	HeapTupleHeader tup = tuple->t_data;
+	bool		hasnulls = HeapTupleHasNulls(tuple);
+	Form_pg_attribute *att = desc->attrs;
+	int			tupnatts;
+	int			attnum;
+	char	   *tp;				/* ptr to tuple data */
+	long		off;			/* offset in tuple data */
+	bits8	   *bp = tup->t_bits;		/* ptr to null bitmap in tuple */
+	bool		slow = false;	/* can we use/set attcacheoff? */
+
+	Assert(natts <= desc->natts);
+
+	tupnatts = Min(HeapTupleHeaderGetNatts(tup), natts);
+
+	tp = (char *) tup + tup->t_hoff;
+
+	off = 0;
+
+	for (attnum = 0; attnum < tupnatts; attnum++)
+	{
+		Form_pg_attribute thisatt = att[attnum];
+
+		if (hasnulls && att_isnull(attnum, bp))
+		{
+			values[attnum] = (Datum) 0;
+			isnull[attnum] = true;
+			slow = true;		/* can't use attcacheoff anymore */
+			continue;
+		}
+
+		isnull[attnum] = false;
+
+		if (!slow && thisatt->attcacheoff >= 0)
+			off = thisatt->attcacheoff;
+		else if (thisatt->attlen == -1)
+		{
+			/*
+			 * We can only cache the offset for a varlena attribute if the
+			 * offset is already suitably aligned, so that there would be no
+			 * pad bytes in any case: then the offset will be valid for either
+			 * an aligned or unaligned value.
+			 */
+			if (!slow &&
+				off == att_align_nominal(off, thisatt->attalign))
+				thisatt->attcacheoff = off;
+			else
+			{
+				off = att_align_pointer(off, thisatt->attalign, -1,
+										tp + off);
+				slow = true;
+			}
+		}
+		else
+		{
+			/* not varlena, so safe to use att_align_nominal */
+			off = att_align_nominal(off, thisatt->attalign);
+
+			if (!slow)
+				thisatt->attcacheoff = off;
+		}
+
+		values[attnum] = fetchatt(thisatt, tp + off);
+
+		off = att_addlength_pointer(off, thisatt->attlen, tp + off);
+
+		if (thisatt->attlen <= 0)
+			slow = true;		/* can't use attcacheoff anymore */
+	}
+
+	/*
+	 * If tuple doesn't have all the atts indicated by desc, read the rest as
+	 * null.
+	 */
+	for (; attnum < natts; attnum++)
+	{
+		values[attnum] = (Datum) 0;
+		isnull[attnum] = true;
 	}
 }
 
@@ -37,12 +37,14 @@ extern void pglogical_write_commit(StringInfo out, PGLogicalOutputData *data,
 extern void pglogical_write_origin(StringInfo out, const char *origin,
 		XLogRecPtr origin_lsn);
 extern void pglogical_write_insert(StringInfo out, PGLogicalOutputData *data,
-		Relation rel, HeapTuple newtuple, Bitmapset *att_filter);
-extern void pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
-		Relation rel, HeapTuple oldtuple, HeapTuple newtuple,
+		Relation rel, PGLRelMetaCacheEntry *cache_entry, HeapTuple newtuple,
 		Bitmapset *att_filter);
+extern void pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
+		Relation rel, PGLRelMetaCacheEntry *cache_entry, HeapTuple oldtuple,
+		HeapTuple newtuple, Bitmapset *att_filter);
 extern void pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
-		Relation rel, HeapTuple oldtuple, Bitmapset *att_filter);
+		Relation rel, PGLRelMetaCacheEntry *cache_entry, HeapTuple oldtuple,
+		Bitmapset *att_filter);
 extern void write_startup_message(StringInfo out, List *msg);
 
 #endif /* PG_LOGICAL_PROTO_NATIVE_H */
@@ -14,25 +14,69 @@
 #include "pglogical_output.h"
 
 #include "utils/inval.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/syscache.h"
 
 #include "pglogical_output_internal.h"
 #include "pglogical_relmetacache.h"
 
 
 static void relmeta_cache_callback(Datum arg, Oid relid);
+static void relmeta_cache_namespace_callback(Datum arg, int cacheid,
+											 uint32 hashvalue);
+static void relmeta_cache_invalidate(struct PGLRelMetaCacheEntry *hentry);
+static void relmeta_cache_remove(struct PGLRelMetaCacheEntry *hentry);
+static void relmeta_cache_release(struct PGLRelMetaCacheEntry *hentry);
 
 static HTAB *RelMetaCache = NULL;
 
+/* Invalidated entries waiting for pglogical_prune_relmetacache() */
+static dlist_head RelMetaCachePruneList = DLIST_STATIC_INIT(RelMetaCachePruneList);
+
+/*
+ * Maximum number of entries requested by the client (-1 for no limit, 0 to
+ * resend metadata with every change) and the entries in least recently used
+ * order, most recent first.
+ */
+static int RelMetaCacheSize = -1;
+static dlist_head RelMetaCacheLRU = DLIST_STATIC_INIT(RelMetaCacheLRU);
+
+/* Last compact id handed out in this decoding session */
+static uint32 RelMetaCacheLastId = 0;
+
+/*
+ * Compact ids handed out in this decoding session by relid. Unlike the cache
+ * entries these survive invalidation and eviction, so a relation keeps its
+ * id for the whole session and the client doesn't accumulate a new copy of
+ * the relation for every invalidation.
+ */
+typedef struct RelMetaCacheIdEntry
+{
+	Oid relid;
+	uint32 compact_id;
+} RelMetaCacheIdEntry;
+
+static HTAB *RelMetaCacheIds = NULL;
+
+/* Memory context of the decoding session, parent of the send plans */
+static MemoryContext RelMetaCacheDecodingContext = NULL;
+
 /*
  * Initialize the relation metadata cache for a decoding session.
  *
- * The hash table is destoyed at the end of a decoding session. While
+ * The hash table is emptied at the end of a decoding session. While
  * relcache invalidations still exist and will still be invoked, they
- * will just see the null hash table global and take no action.
+ * will just see no entries and take no action.
+ *
+ * The send plans of the entries live in children of decoding_context, so
+ * they go away with the decoding session even if it ends with an error
+ * before pglogical_destroy_relmetacache() is called.
+ *
+ * cache_size is the relmeta_cache_size requested by the client.
  */
 void
-pglogical_init_relmetacache(MemoryContext decoding_context)
+pglogical_init_relmetacache(MemoryContext decoding_context, int cache_size)
 {
 	HASHCTL	ctl;
 	int		hash_flags;
@@ -63,8 +107,57 @@ pglogical_init_relmetacache(MemoryContext decoding_context)
 
 		Assert(RelMetaCache != NULL);
 
+		ctl.entrysize = sizeof(RelMetaCacheIdEntry);
+		RelMetaCacheIds = hash_create("pglogical relation compact ids", 128,
+									  &ctl, hash_flags);
+
 		CacheRegisterRelcacheCallback(relmeta_cache_callback, (Datum)0);
+		CacheRegisterSyscacheCallback(NAMESPACEOID,
+									  relmeta_cache_namespace_callback,
+									  (Datum)0);
+	}
+	else
+	{
+		HASH_SEQ_STATUS status;
+		struct PGLRelMetaCacheEntry *hentry;
+
+		/*
+		 * Entries left behind by a session that failed. Their send plans
+		 * were already freed together with its decoding context.
+		 */
+		hash_seq_init(&status, RelMetaCache);
+
+		while ((hentry = (struct PGLRelMetaCacheEntry*) hash_seq_search(&status)) != NULL)
+		{
+			if (hash_search(RelMetaCache,
+							(void *) &hentry->relid,
+							HASH_REMOVE, NULL) == NULL)
+				elog(ERROR, "hash table corrupted");
+		}
+	}
+
+	/* Every decoding session hands out its ids from scratch. */
+	if (hash_get_num_entries(RelMetaCacheIds) > 0)
+	{
+		HASH_SEQ_STATUS status;
+		RelMetaCacheIdEntry *identry;
+
+		hash_seq_init(&status, RelMetaCacheIds);
+
+		while ((identry = (RelMetaCacheIdEntry *) hash_seq_search(&status)) != NULL)
+		{
+			if (hash_search(RelMetaCacheIds,
+							(void *) &identry->relid,
+							HASH_REMOVE, NULL) == NULL)
+				elog(ERROR, "hash table corrupted");
+		}
 	}
+
+	RelMetaCacheDecodingContext = decoding_context;
+	RelMetaCacheSize = cache_size;
+	RelMetaCacheLastId = 0;
+	dlist_init(&RelMetaCachePruneList);
+	dlist_init(&RelMetaCacheLRU);
 }
 
 /*
@@ -89,13 +182,63 @@ relmeta_cache_callback(Datum arg, Oid relid)
 	 * entirely normal, since there's no way to unregister for an
 	 * invalidation event. So we don't care if it's found or not.
 	 */
+	if (relid == InvalidOid)
+	{
+		HASH_SEQ_STATUS status;
+
+		hash_seq_init(&status, RelMetaCache);
+
+		while ((hentry = (struct PGLRelMetaCacheEntry*) hash_seq_search(&status)) != NULL)
+			relmeta_cache_invalidate(hentry);
+
+		return;
+	}
+
 	hentry = (struct PGLRelMetaCacheEntry *)
 		hash_search(RelMetaCache, &relid, HASH_FIND, NULL);
 
 	if (hentry != NULL)
-		hentry->is_valid = false;
+		relmeta_cache_invalidate(hentry);
  }
 
+/*
+ * Renaming a schema doesn't invalidate relcache entries of its relations,
+ * but the send plans may contain the schema name, so rebuild all of them.
+ */
+static void
+relmeta_cache_namespace_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	HASH_SEQ_STATUS status;
+	struct PGLRelMetaCacheEntry *hentry;
+
+	if (RelMetaCache == NULL)
+		return;
+
+	hash_seq_init(&status, RelMetaCache);
+
+	while ((hentry = (struct PGLRelMetaCacheEntry*) hash_seq_search(&status)) != NULL)
+		hentry->plan_valid = false;
+}
+
+/*
+ * Mark the entry invalid and queue it for pruning.
+ *
+ * Queueing the entries lets pglogical_prune_relmetacache() visit only the
+ * invalidated entries instead of scanning the whole cache on every commit.
+ */
+static void
+relmeta_cache_invalidate(struct PGLRelMetaCacheEntry *hentry)
+{
+	/* The send plan is rebuilt on next use even before the purge. */
+	hentry->plan_valid = false;
+
+	if (hentry->is_valid)
+	{
+		hentry->is_valid = false;
+		dlist_push_tail(&RelMetaCachePruneList, &hentry->prune_node);
+	}
+}
+
 /*
  * Look up an entry, creating it if not found.
  *
@@ -103,6 +246,10 @@ relmeta_cache_callback(Datum arg, Oid relid)
  * hook can set is_cached to skip subsequent updates if it sent a
  * complete response that the client will cache.
  *
+ * If the client limited the cache size, the least recently used entries
+ * are evicted once the limit is exceeded, so their metadata is sent again
+ * when they are next used.
+ *
  * Returns true on a cache hit, false on a miss.
  */
 bool
@@ -122,15 +269,75 @@ pglogical_cache_relmeta(struct PGLogicalOutputData *data,
 
 	if (!found)
 	{
+		RelMetaCacheIdEntry *identry;
+		bool		id_found;
+
 		Assert(hentry->relid = RelationGetRelid(rel));
+		/*
+		 * A relation keeps its id when its entry is recreated after
+		 * invalidation or eviction, and the id is never given to another
+		 * relation. The entry isn't cached by the client yet, so its
+		 * metadata (and id) is sent before any row referencing it and
+		 * replaces what the client had under that id.
+		 */
+		identry = (RelMetaCacheIdEntry *) hash_search(RelMetaCacheIds,
+										(void *)(&RelationGetRelid(rel)),
+										HASH_ENTER, &id_found);
+		if (!id_found)
+			identry->compact_id = ++RelMetaCacheLastId;
+		hentry->compact_id = identry->compact_id;
 		hentry->is_cached = false;
 		/* Only used for lazy purging of invalidations */
 		hentry->is_valid = true;
+		hentry->plan_valid = false;
+		hentry->plan_context =
+			AllocSetContextCreate(RelMetaCacheDecodingContext,
+								  "pglogical relation send plan",
+								  ALLOCSET_SMALL_MINSIZE,
+								  ALLOCSET_SMALL_INITSIZE,
+								  ALLOCSET_SMALL_MAXSIZE);
+		hentry->plan_att_filter = NULL;
+		hentry->nliveatts = 0;
+		hentry->liveatts = NULL;
+		hentry->deform_natts = 0;
+		hentry->values = NULL;
+		hentry->isnull = NULL;
+		hentry->json_relation = NULL;
+		hentry->json_use_row_to_json = false;
 	}
 
 	Assert(hentry != NULL);
 
+	if (RelMetaCacheSize > 0)
+	{
+		if (found)
+			dlist_move_head(&RelMetaCacheLRU, &hentry->lru_node);
+		else
+		{
+			dlist_push_head(&RelMetaCacheLRU, &hentry->lru_node);
+
+			/*
+			 * Nothing but the entry we're returning can be referenced at
+			 * this point, so the others can be removed right away.
+			 */
+			while (hash_get_num_entries(RelMetaCache) > RelMetaCacheSize)
+			{
+				struct PGLRelMetaCacheEntry *victim;
+
+				victim = dlist_tail_element(struct PGLRelMetaCacheEntry,
+											lru_node, &RelMetaCacheLRU);
+				Assert(victim != hentry);
+				relmeta_cache_remove(victim);
+			}
+		}
+	}
+
 	*entry = hentry;
+
+	/* Client doesn't cache anything, send the metadata every time. */
+	if (RelMetaCacheSize == 0)
+		return false;
+
 	return hentry->is_cached;
 }
 
@@ -150,12 +357,16 @@ pglogical_destroy_relmetacache(void)
 
 		while ((hentry = (struct PGLRelMetaCacheEntry*) hash_seq_search(&status)) != NULL)
 		{
+			relmeta_cache_release(hentry);
 			if (hash_search(RelMetaCache,
 							(void *) &hentry->relid,
 							HASH_REMOVE, NULL) == NULL)
 				elog(ERROR, "hash table corrupted");
 		}
 	}
+
+	dlist_init(&RelMetaCachePruneList);
+	dlist_init(&RelMetaCacheLRU);
 }
 
 /*
@@ -167,19 +378,43 @@ pglogical_destroy_relmetacache(void)
 void
 pglogical_prune_relmetacache(void)
 {
-	HASH_SEQ_STATUS status;
-	struct PGLRelMetaCacheEntry *hentry;
-
-	hash_seq_init(&status, RelMetaCache);
-
-	while ((hentry = (struct PGLRelMetaCacheEntry*) hash_seq_search(&status)) != NULL)
+	while (!dlist_is_empty(&RelMetaCachePruneList))
 	{
-		if (!hentry->is_valid)
-		{
-			if (hash_search(RelMetaCache,
-							(void *) &hentry->relid,
-							HASH_REMOVE, NULL) == NULL)
-				elog(ERROR, "hash table corrupted");
-		}
+		struct PGLRelMetaCacheEntry *hentry;
+
+		hentry = dlist_head_element(struct PGLRelMetaCacheEntry, prune_node,
+									&RelMetaCachePruneList);
+		Assert(!hentry->is_valid);
+		relmeta_cache_remove(hentry);
 	}
 }
+
+/*
+ * Remove the entry from the cache and from the lists it's on.
+ */
+static void
+relmeta_cache_remove(struct PGLRelMetaCacheEntry *hentry)
+{
+	if (!hentry->is_valid)
+		dlist_delete(&hentry->prune_node);
+	if (RelMetaCacheSize > 0)
+		dlist_delete(&hentry->lru_node);
+
+	relmeta_cache_release(hentry);
+	if (hash_search(RelMetaCache,
+					(void *) &hentry->relid,
+					HASH_REMOVE, NULL) == NULL)
+		elog(ERROR, "hash table corrupted");
+}
+
+/*
+ * Free the memory used by the send plan of the entry.
+ */
+static void
+relmeta_cache_release(struct PGLRelMetaCacheEntry *hentry)
+{
+	if (hentry->plan_context != NULL)
+		MemoryContextDelete(hentry->plan_context);
+	hentry->plan_context = NULL;
+	hentry->plan_valid = false;
+}
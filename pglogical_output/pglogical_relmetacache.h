@@ -3,20 +3,65 @@
 
 #include "pglogical_output.h"
 
+#include "fmgr.h"
+#include "lib/ilist.h"
+#include "nodes/bitmapset.h"
 #include "utils/memutils.h"
 #include "utils/relcache.h"
 
 
+/* How to send one column of the relation. */
+typedef struct PGLRelMetaColumn
+{
+	int			attno;			/* offset in the tuple descriptor */
+	int16		attlen;
+	bool		attbyval;
+	char		transfer_type;	/* 'i', 'b' or 't' */
+	FmgrInfo	finfo;			/* send or output function */
+	/* JSON protocol only */
+	char		json_kind;		/* how to write the value, see proto_json */
+	char	   *json_key;		/* escaped column name followed by ':' */
+} PGLRelMetaColumn;
+
 typedef struct PGLRelMetaCacheEntry
 {
 	Oid relid;
+	/*
+	 * Small session-local id of the relation, used instead of relid by the
+	 * compact native protocol encoding. A recreated entry keeps its id.
+	 */
+	uint32 compact_id;
 	/* Does the client have this relation cached? */
 	bool is_cached;
 	/* Entry is valid and not due to be purged */
 	bool is_valid;
+	/* Position in the list of entries due to be purged, while !is_valid */
+	dlist_node prune_node;
+	/* Position in the LRU list, only used when the cache size is limited */
+	dlist_node lru_node;
+
+	/*
+	 * Columns to send (after applying plan_att_filter) and how to send them,
+	 * only valid while plan_valid is set. Kept in plan_context.
+	 */
+	bool plan_valid;
+	MemoryContext plan_context;
+	Bitmapset *plan_att_filter;
+	int nliveatts;
+	PGLRelMetaColumn *liveatts;
+	/* Number of leading attributes to deform and buffers for them. */
+	int deform_natts;
+	Datum *values;
+	bool *isnull;
+	/*
+	 * JSON protocol only: the escaped relation key of change messages and
+	 * whether the rows have to be converted by row_to_json.
+	 */
+	char *json_relation;
+	bool json_use_row_to_json;
 } PGLRelMetaCacheEntry;
 
-extern void pglogical_init_relmetacache(MemoryContext decoding_context);
+extern void pglogical_init_relmetacache(MemoryContext decoding_context, int cache_size);
 extern bool pglogical_cache_relmeta(PGLogicalOutputData *data, Relation rel, PGLRelMetaCacheEntry **entry);
 extern void pglogical_destroy_relmetacache(void);
 extern void pglogical_prune_relmetacache(void);
@@ -0,0 +1,74 @@
+\i sql/basic_setup.sql
+
+-- Startup parameters of the native protocol message, 'S', format version
+-- and then null terminated key and value pairs.
+CREATE FUNCTION native_startup_params(msg bytea)
+RETURNS TABLE ("key" text, "value" text)
+LANGUAGE sql
+AS $$
+SELECT p[i], p[i + 1]
+FROM (SELECT string_to_array(encode(substring(msg from 3), 'escape'), '\000') AS p) s,
+	generate_series(1, array_length(p, 1) - 1, 2) i;
+$$;
+
+-- Batched, compact and compressed stream. The startup reply confirms what
+-- the client gets, the reply to compression is "none" if the server was
+-- built without zlib.
+SELECT key, value
+FROM native_startup_params((
+	SELECT data FROM pg_logical_slot_peek_binary_changes('regression_slot',
+		NULL, NULL,
+		'expected_encoding', 'UTF8',
+		'min_proto_version', '1',
+		'max_proto_version', '1',
+		'startup_params_format', '1',
+		'message_batch_size', '65536',
+		'compact_encoding', 'true',
+		'compression', 'zlib')
+	LIMIT 1))
+WHERE key IN ('message_batch_size', 'compact_encoding', 'compression')
+ORDER BY key;
+
+-- Everything after the startup message comes in 'Z' messages
+SELECT DISTINCT chr(get_byte(data, 0)) AS msgtype
+FROM pg_logical_slot_peek_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'message_batch_size', '65536',
+	'compact_encoding', 'true',
+	'compression', 'zlib')
+ORDER BY 1;
+
+-- Unknown compression methods are refused by sending uncompressed stream
+SELECT key, value
+FROM native_startup_params((
+	SELECT data FROM pg_logical_slot_peek_binary_changes('regression_slot',
+		NULL, NULL,
+		'expected_encoding', 'UTF8',
+		'min_proto_version', '1',
+		'max_proto_version', '1',
+		'startup_params_format', '1',
+		'message_batch_size', '65536',
+		'compression', 'lz77')
+	LIMIT 1))
+WHERE key IN ('message_batch_size', 'compact_encoding', 'compression')
+ORDER BY key;
+
+-- Batches without compression are sent as 'M' messages
+SELECT DISTINCT chr(get_byte(data, 0)) AS msgtype
+FROM pg_logical_slot_peek_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'message_batch_size', '65536',
+	'compression', 'lz77')
+ORDER BY 1;
+
+DROP FUNCTION native_startup_params(bytea);
+
+\i sql/basic_teardown.sql
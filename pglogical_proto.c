@@ -14,6 +14,7 @@
 
 #include "miscadmin.h"
 
+#include "access/hash.h"
 #include "access/htup_details.h"
 #include "access/heapam.h"
 
@@ -38,6 +39,8 @@
 
 #include "mb/pg_wchar.h"
 
+#include "nodes/bitmapset.h"
+
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
@@ -51,10 +54,18 @@
 
 #define IS_REPLICA_IDENTITY 1
 
+/* Message flag: relation id and field lengths are variable length ints */
+#define COMPACT_ENCODING 1
+
 static void pglogical_read_attrs(StringInfo in, char ***attrnames,
-								  int *nattrnames);
+								  int *nattrnames, Bitmapset **identity);
 static void pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
-					  PGLogicalTupleData *tuple);
+					  PGLogicalTupleData *tuple, uint8 flags);
+static uint32 pglogical_read_relid(StringInfo in, uint8 flags);
+static uint32 pglogical_read_length(StringInfo in, uint8 flags);
+static uint32 pglogical_getmsgvarint(StringInfo in);
+static bool pglogical_hash_tuple_key(StringInfo in, uint8 flags, int natts,
+									 const int16 *keyattlens, uint32 *hash);
 
 /*
  * Read functions.
@@ -120,11 +131,11 @@ pglogical_read_origin(StringInfo in, XLogRecPtr *origin_lsn)
 /*
  * Read INSERT from stream.
  *
- * Fills the new tuple.
+ * Fills the new tuple, which is owned by the returned relation.
  */
 PGLogicalRelation *
 pglogical_read_insert(StringInfo in, LOCKMODE lockmode,
-					   PGLogicalTupleData *newtup)
+					   PGLogicalTupleData **newtup)
 {
 	char		action;
 	uint32		relid;
@@ -133,10 +144,10 @@ pglogical_read_insert(StringInfo in, LOCKMODE lockmode,
 
 	/* read the flags */
 	flags = pq_getmsgbyte(in);
-	Assert(flags == 0);
+	Assert((flags & ~COMPACT_ENCODING) == 0);
 
 	/* read the relation id */
-	relid = pq_getmsgint(in, 4);
+	relid = pglogical_read_relid(in, flags);
 
 	action = pq_getmsgbyte(in);
 	if (action != 'N')
@@ -145,17 +156,21 @@ pglogical_read_insert(StringInfo in, LOCKMODE lockmode,
 
 	rel = pglogical_relation_open(relid, lockmode);
 
-	pglogical_read_tuple(in, rel, newtup);
+	*newtup = &rel->newtup;
+	pglogical_read_tuple(in, rel, *newtup, flags);
 
 	return rel;
 }
 
 /*
  * Read UPDATE from stream.
+ *
+ * Fills the old (if any) and new tuple, which are owned by the returned
+ * relation.
  */
 PGLogicalRelation *
 pglogical_read_update(StringInfo in, LOCKMODE lockmode, bool *hasoldtup,
-					   PGLogicalTupleData *oldtup, PGLogicalTupleData *newtup)
+					   PGLogicalTupleData **oldtup, PGLogicalTupleData **newtup)
 {
 	char		action;
 	Oid			relid;
@@ -164,10 +179,10 @@ pglogical_read_update(StringInfo in, LOCKMODE lockmode, bool *hasoldtup,
 
 	/* read the flags */
 	flags = pq_getmsgbyte(in);
-	Assert(flags == 0);
+	Assert((flags & ~COMPACT_ENCODING) == 0);
 
 	/* read the relation id */
-	relid = pq_getmsgint(in, 4);
+	relid = pglogical_read_relid(in, flags);
 
 	/* read and verify action */
 	action = pq_getmsgbyte(in);
@@ -180,7 +195,8 @@ pglogical_read_update(StringInfo in, LOCKMODE lockmode, bool *hasoldtup,
 	/* check for old tuple */
 	if (action == 'K' || action == 'O')
 	{
-		pglogical_read_tuple(in, rel, oldtup);
+		*oldtup = &rel->oldtup;
+		pglogical_read_tuple(in, rel, *oldtup, flags);
 		*hasoldtup = true;
 		action = pq_getmsgbyte(in);
 	}
@@ -192,7 +208,8 @@ pglogical_read_update(StringInfo in, LOCKMODE lockmode, bool *hasoldtup,
 		elog(ERROR, "expected action 'N', got %c",
 			 action);
 
-	pglogical_read_tuple(in, rel, newtup);
+	*newtup = &rel->newtup;
+	pglogical_read_tuple(in, rel, *newtup, flags);
 
 	return rel;
 }
@@ -200,11 +217,11 @@ pglogical_read_update(StringInfo in, LOCKMODE lockmode, bool *hasoldtup,
 /*
  * Read DELETE from stream.
  *
- * Fills the old tuple.
+ * Fills the old tuple, which is owned by the returned relation.
  */
 PGLogicalRelation *
 pglogical_read_delete(StringInfo in, LOCKMODE lockmode,
-					   PGLogicalTupleData *oldtup)
+					   PGLogicalTupleData **oldtup)
 {
 	char		action;
 	Oid			relid;
@@ -213,10 +230,10 @@ pglogical_read_delete(StringInfo in, LOCKMODE lockmode,
 
 	/* read the flags */
 	flags = pq_getmsgbyte(in);
-	Assert(flags == 0);
+	Assert((flags & ~COMPACT_ENCODING) == 0);
 
 	/* read the relation id */
-	relid = pq_getmsgint(in, 4);
+	relid = pglogical_read_relid(in, flags);
 
 	/* read and verify action */
 	action = pq_getmsgbyte(in);
@@ -225,7 +242,8 @@ pglogical_read_delete(StringInfo in, LOCKMODE lockmode,
 
 	rel = pglogical_relation_open(relid, lockmode);
 
-	pglogical_read_tuple(in, rel, oldtup);
+	*oldtup = &rel->oldtup;
+	pglogical_read_tuple(in, rel, *oldtup, flags);
 
 	return rel;
 }
@@ -238,7 +256,7 @@ pglogical_read_delete(StringInfo in, LOCKMODE lockmode,
  */
 static void
 pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
-					  PGLogicalTupleData *tuple)
+					  PGLogicalTupleData *tuple, uint8 flags)
 {
 	int			i;
 	int			natts;
@@ -249,8 +267,9 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 	if (action != 'T')
 		elog(ERROR, "expected TUPLE, got %c", action);
 
-	memset(tuple->nulls, 1, sizeof(tuple->nulls));
-	memset(tuple->changed, 0, sizeof(tuple->changed));
+	/* Only reset the attributes the local relation actually has. */
+	memset(tuple->nulls, 1, tuple->natts * sizeof(bool));
+	memset(tuple->changed, 0, tuple->natts * sizeof(bool));
 
 	natts = pq_getmsgint(in, 2);
 	if (rel->natts != natts)
@@ -281,7 +300,7 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 				tuple->nulls[attid] = false;
 				tuple->changed[attid] = true;
 
-				len = pq_getmsgint(in, 4); /* read length */
+				len = pglogical_read_length(in, flags);
 				data = pq_getmsgbytes(in, len);
 
 				/* and data */
@@ -292,24 +311,25 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 				break;
 			case 'b': /* binary send/recv format */
 				{
-					Oid typreceive;
-					Oid typioparam;
+					FmgrInfo   *typreceive;
+					Oid			typioparam;
 					StringInfoData buf;
 
 					tuple->nulls[attid] = false;
 					tuple->changed[attid] = true;
 
-					len = pq_getmsgint(in, 4); /* read length */
+					len = pglogical_read_length(in, flags);
 
-					getTypeBinaryInputInfo(att->atttypid,
-										   &typreceive, &typioparam);
+					typreceive = pglogical_relation_column_input(rel, attid,
+																 true,
+																 &typioparam);
 
 					/* create StringInfo pointing into the bigger buffer */
-					initStringInfo(&buf);
-					/* and data */
 					buf.data = (char *) pq_getmsgbytes(in, len);
 					buf.len = len;
-					tuple->values[attid] = OidReceiveFunctionCall(
+					buf.maxlen = len;
+					buf.cursor = 0;
+					tuple->values[attid] = ReceiveFunctionCall(
 						typreceive, &buf, typioparam, att->atttypmod);
 
 					if (buf.len != buf.cursor)
@@ -320,18 +340,20 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 				}
 			case 't': /* text format */
 				{
-					Oid typinput;
-					Oid typioparam;
+					FmgrInfo   *typinput;
+					Oid			typioparam;
 
 					tuple->nulls[attid] = false;
 					tuple->changed[attid] = true;
 
-					len = pq_getmsgint(in, 4); /* read length */
+					len = pglogical_read_length(in, flags);
 
-					getTypeInputInfo(att->atttypid, &typinput, &typioparam);
+					typinput = pglogical_relation_column_input(rel, attid,
+															   false,
+															   &typioparam);
 					/* and data */
 					data = (char *) pq_getmsgbytes(in, len);
-					tuple->values[attid] = OidInputFunctionCall(
+					tuple->values[attid] = InputFunctionCall(
 						typinput, (char *) data, typioparam, att->atttypmod);
 				}
 				break;
@@ -370,20 +392,226 @@ pglogical_read_rel(StringInfo in)
 	relname = (char *) pq_getmsgbytes(in, len);
 
 	/* Get attribute description */
-	pglogical_read_attrs(in, &attrnames, &natts);
+	pglogical_read_attrs(in, &attrnames, &natts, NULL);
 
 	pglogical_relation_cache_update(relid, schemaname, relname, natts, attrnames);
 
 	return relid;
 }
 
+/*
+ * Get the remote relation id of RELATION, INSERT, UPDATE or DELETE message
+ * without consuming the message.
+ */
+uint32
+pglogical_peek_relid(StringInfo in)
+{
+	StringInfoData	copy;
+	uint8			flags;
+
+	memcpy(&copy, in, sizeof(StringInfoData));
+
+	(void) pq_getmsgbyte(&copy);	/* message type */
+	flags = pq_getmsgbyte(&copy);
+
+	return pglogical_read_relid(&copy, flags);
+}
+
+/*
+ * Get the replica identity columns of RELATION message, as positions in the
+ * attribute list, without consuming the message.
+ */
+Bitmapset *
+pglogical_peek_rel_identity(StringInfo in)
+{
+	StringInfoData	copy;
+	int				len;
+	int				natts;
+	char		  **attrnames;
+	Bitmapset	   *identity;
+
+	memcpy(&copy, in, sizeof(StringInfoData));
+
+	(void) pq_getmsgbyte(&copy);	/* message type */
+	(void) pq_getmsgbyte(&copy);	/* flags */
+	(void) pq_getmsgint(&copy, 4);	/* relation id */
+
+	len = pq_getmsgbyte(&copy);
+	(void) pq_getmsgbytes(&copy, len);
+	len = pq_getmsgbyte(&copy);
+	(void) pq_getmsgbytes(&copy, len);
+
+	pglogical_read_attrs(&copy, &attrnames, &natts, &identity);
+	pfree(attrnames);
+
+	return identity;
+}
+
+/*
+ * Hash the key columns of the tuples in INSERT, UPDATE or DELETE message
+ * without consuming the message.
+ *
+ * keyattlens has an entry for each of natts remote attributes, the length of
+ * the type for key columns and zero for the rest. Stores one hash for every
+ * tuple of the message, that's the old key (if any) and the new tuple for
+ * UPDATE. Returns false if any of the key values isn't present in a form
+ * that can be hashed.
+ */
+bool
+pglogical_peek_change_keys(StringInfo in, int natts, const int16 *keyattlens,
+						   uint32 *hashes, int *nhashes)
+{
+	StringInfoData	copy;
+	uint8			flags;
+	char			action;
+
+	memcpy(&copy, in, sizeof(StringInfoData));
+
+	*nhashes = 0;
+
+	(void) pq_getmsgbyte(&copy);	/* message type */
+	flags = pq_getmsgbyte(&copy);
+	(void) pglogical_read_relid(&copy, flags);
+
+	action = pq_getmsgbyte(&copy);
+	if (action == 'K' || action == 'O')
+	{
+		if (!pglogical_hash_tuple_key(&copy, flags, natts, keyattlens,
+									  &hashes[(*nhashes)++]))
+			return false;
+
+		/* Only UPDATE has anything after the old tuple. */
+		if (copy.cursor >= copy.len)
+			return true;
+
+		action = pq_getmsgbyte(&copy);
+	}
+
+	if (action != 'N')
+		return false;
+
+	return pglogical_hash_tuple_key(&copy, flags, natts, keyattlens,
+									&hashes[(*nhashes)++]);
+}
+
+/*
+ * Read the relation id of INSERT, UPDATE or DELETE message.
+ *
+ * RELATION messages always carry a 4-byte id, it's only compacted in the
+ * much more frequent change messages.
+ */
+static uint32
+pglogical_read_relid(StringInfo in, uint8 flags)
+{
+	if (flags & COMPACT_ENCODING)
+		return pglogical_getmsgvarint(in);
+
+	return pq_getmsgint(in, 4);
+}
+
+/*
+ * Read the length of a column value.
+ */
+static uint32
+pglogical_read_length(StringInfo in, uint8 flags)
+{
+	if (flags & COMPACT_ENCODING)
+		return pglogical_getmsgvarint(in);
+
+	return pq_getmsgint(in, 4);
+}
+
+/*
+ * Read an unsigned integer sent as 7 bit groups, least significant group
+ * first, with the high bit set on all bytes but the last one.
+ */
+static uint32
+pglogical_getmsgvarint(StringInfo in)
+{
+	uint32		result = 0;
+	int			shift = 0;
+	uint8		b;
+
+	do
+	{
+		if (shift > 28)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("invalid variable length integer in message")));
+
+		b = pq_getmsgbyte(in);
+		result |= (uint32) (b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	return result;
+}
+
+/*
+ * Hash the values of the key columns of a tuple, see
+ * pglogical_peek_change_keys.
+ */
+static bool
+pglogical_hash_tuple_key(StringInfo in, uint8 flags, int natts,
+						 const int16 *keyattlens, uint32 *hash)
+{
+	int			i;
+
+	if (pq_getmsgbyte(in) != 'T' || pq_getmsgint(in, 2) != natts)
+		return false;
+
+	*hash = 0;
+
+	for (i = 0; i < natts; i++)
+	{
+		char		kind = pq_getmsgbyte(in);
+		const char *data;
+		int			len;
+
+		if (kind == 'n' || kind == 'u')
+		{
+			/* Key columns can't be NULL, and unchanged ones aren't sent. */
+			if (keyattlens[i] != 0)
+				return false;
+			continue;
+		}
+
+		len = pglogical_read_length(in, flags);
+		data = pq_getmsgbytes(in, len);
+
+		if (keyattlens[i] == 0)
+			continue;
+
+		/*
+		 * The same varlena value can come with either header size, but
+		 * comparing compressed values isn't worth the trouble.
+		 */
+		if (kind == 'i' && keyattlens[i] == -1)
+		{
+			if (VARATT_IS_COMPRESSED(data) || VARATT_IS_EXTERNAL(data))
+				return false;
+
+			len = VARSIZE_ANY_EXHDR(data);
+			data = VARDATA_ANY(data);
+		}
+
+		/* Same as ExecHashGetHashValue() does for multiple keys. */
+		*hash = (*hash << 1) | ((*hash & 0x80000000) ? 1 : 0);
+		*hash ^= DatumGetUInt32(hash_any((const unsigned char *) data, len));
+	}
+
+	return true;
+}
+
 /*
  * Read relation attributes from the outputstream.
  *
- * TODO handle flags.
+ * Positions of the replica identity columns are returned in identity unless
+ * it's NULL.
  */
 static void
-pglogical_read_attrs(StringInfo in, char ***attrnames, int *nattrnames)
+pglogical_read_attrs(StringInfo in, char ***attrnames, int *nattrnames,
+					 Bitmapset **identity)
 {
 	int			i;
 	uint16		nattrs;
@@ -397,6 +625,9 @@ pglogical_read_attrs(StringInfo in, char ***attrnames, int *nattrnames)
 	nattrs = pq_getmsgint(in, 2);
 	attrs = palloc(nattrs * sizeof(char *));
 
+	if (identity != NULL)
+		*identity = NULL;
+
 	/* read the attributes */
 	for (i = 0; i < nattrs; i++)
 	{
@@ -407,7 +638,9 @@ pglogical_read_attrs(StringInfo in, char ***attrnames, int *nattrnames)
 		if (blocktype != 'C')
 			elog(ERROR, "expected COLUMN, got %c", blocktype);
 		flags = pq_getmsgbyte(in);
-//		Assert(flags == 0);
+
+		if (identity != NULL && (flags & IS_REPLICA_IDENTITY))
+			*identity = bms_add_member(*identity, i);
 
 		blocktype = pq_getmsgbyte(in);		/* column name block follows */
 		if (blocktype != 'N')
@@ -13,17 +13,11 @@
 #ifndef PGLOGICAL_PROTO_H
 #define PGLOGICAL_PROTO_H
 
+#include "nodes/bitmapset.h"
 #include "utils/timestamp.h"
 
 #include "pglogical_relcache.h"
 
-typedef struct PGLogicalTupleData
-{
-	Datum	values[MaxTupleAttributeNumber];
-	bool	nulls[MaxTupleAttributeNumber];
-	bool	changed[MaxTupleAttributeNumber];
-} PGLogicalTupleData;
-
 extern void pglogical_read_begin(StringInfo in, XLogRecPtr *remote_lsn,
 					  TimestampTz *committime, TransactionId *remote_xid);
 extern void pglogical_read_commit(StringInfo in, XLogRecPtr *commit_lsn,
@@ -31,12 +25,17 @@ extern void pglogical_read_commit(StringInfo in, XLogRecPtr *commit_lsn,
 extern char *pglogical_read_origin(StringInfo in, XLogRecPtr *origin_lsn);
 
 extern uint32 pglogical_read_rel(StringInfo in);
+extern uint32 pglogical_peek_relid(StringInfo in);
+extern Bitmapset *pglogical_peek_rel_identity(StringInfo in);
+extern bool pglogical_peek_change_keys(StringInfo in, int natts,
+									   const int16 *keyattlens,
+									   uint32 *hashes, int *nhashes);
 
 extern PGLogicalRelation *pglogical_read_insert(StringInfo in, LOCKMODE lockmode,
-					   PGLogicalTupleData *newtup);
+					   PGLogicalTupleData **newtup);
 extern PGLogicalRelation *pglogical_read_update(StringInfo in, LOCKMODE lockmode, bool *hasoldtup,
-					   PGLogicalTupleData *oldtup, PGLogicalTupleData *newtup);
+					   PGLogicalTupleData **oldtup, PGLogicalTupleData **newtup);
 extern PGLogicalRelation *pglogical_read_delete(StringInfo in, LOCKMODE lockmode,
-												 PGLogicalTupleData *oldtup);
+												 PGLogicalTupleData **oldtup);
 
 #endif /* PGLOGICAL_PROTO_H */
@@ -12,18 +12,29 @@
  */
 #include "postgres.h"
 
+#include "access/genam.h"
 #include "access/heapam.h"
+#include "access/nbtree.h"
 
 #include "catalog/pg_trigger.h"
 
 #include "commands/trigger.h"
 
+#include "executor/executor.h"
+
+#include "optimizer/planner.h"
+
+#include "rewrite/rewriteHandler.h"
+
 #include "utils/builtins.h"
 #include "utils/catcache.h"
 #include "utils/hsearch.h"
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/syscache.h"
 
 #include "pglogical_relcache.h"
 
@@ -33,6 +44,205 @@ static HTAB *PGLogicalRelationHash = NULL;
 static void pglogical_relcache_init(void);
 static int tupdesc_get_att_by_name(TupleDesc desc, const char *attname);
 
+/*
+ * Prepare default expressions for the local columns which don't exist on the
+ * remote side, so that the apply only has to initialize and evaluate them.
+ *
+ * Must be called with mapcontext freshly reset.
+ */
+static void
+relcache_build_defaults(PGLogicalRelation *entry, TupleDesc desc)
+{
+	MemoryContext	oldcontext;
+	bool		   *mapped;
+	int				attnum;
+	int				i;
+
+	entry->ndefaults = 0;
+	entry->defmap = NULL;
+	entry->defexprs = NULL;
+
+	/* We get all the data via replication, no need to evaluate anything. */
+	if (desc->natts == entry->natts)
+		return;
+
+	mapped = (bool *) palloc0(desc->natts * sizeof(bool));
+	for (i = 0; i < entry->natts; i++)
+		mapped[entry->attmap[i]] = true;
+
+	oldcontext = MemoryContextSwitchTo(entry->mapcontext);
+
+	entry->defmap = (int *) palloc(desc->natts * sizeof(int));
+	entry->defexprs = (Expr **) palloc(desc->natts * sizeof(Expr *));
+
+	for (attnum = 0; attnum < desc->natts; attnum++)
+	{
+		Expr	   *defexpr;
+
+		if (desc->attrs[attnum]->attisdropped || mapped[attnum])
+			continue;
+
+		defexpr = (Expr *) build_column_default(entry->rel, attnum + 1);
+
+		if (defexpr != NULL)
+		{
+			/* Run the expression through planner */
+			entry->defexprs[entry->ndefaults] = expression_planner(defexpr);
+			entry->defmap[entry->ndefaults] = attnum;
+			entry->ndefaults++;
+		}
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+	pfree(mapped);
+}
+
+/*
+ * Resolve the equality operators for the key columns of an index.
+ */
+static PGLogicalIndexKeyInfo *
+relcache_build_index_keyinfo(PGLogicalRelation *entry, Relation idxrel)
+{
+	PGLogicalIndexKeyInfo *keyinfo;
+	MemoryContext	oldcontext;
+	Datum			indclassDatum;
+	bool			isnull;
+	oidvector	   *opclass;
+	int				nkeys = RelationGetNumberOfAttributes(idxrel);
+	int				attoff;
+
+	indclassDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
+									Anum_pg_index_indclass, &isnull);
+	Assert(!isnull);
+	opclass = (oidvector *) DatumGetPointer(indclassDatum);
+
+	oldcontext = MemoryContextSwitchTo(entry->mapcontext);
+
+	keyinfo = (PGLogicalIndexKeyInfo *) palloc(sizeof(PGLogicalIndexKeyInfo));
+	keyinfo->indexoid = RelationGetRelid(idxrel);
+	keyinfo->nkeys = nkeys;
+	keyinfo->attnums = (AttrNumber *) palloc(nkeys * sizeof(AttrNumber));
+	keyinfo->collations = (Oid *) palloc(nkeys * sizeof(Oid));
+	keyinfo->eqfuncs = (FmgrInfo *) palloc(nkeys * sizeof(FmgrInfo));
+
+	for (attoff = 0; attoff < nkeys; attoff++)
+	{
+		Oid			operator;
+		Oid			opfamily;
+		Oid			optype = get_opclass_input_type(opclass->values[attoff]);
+
+		opfamily = get_opclass_family(opclass->values[attoff]);
+
+		operator = get_opfamily_member(opfamily, optype,
+									   optype,
+									   BTEqualStrategyNumber);
+
+		if (!OidIsValid(operator))
+			elog(ERROR,
+				 "could not lookup equality operator for type %u in opfamily %u",
+				 optype, opfamily);
+
+		keyinfo->attnums[attoff] = idxrel->rd_index->indkey.values[attoff];
+		keyinfo->collations[attoff] = idxrel->rd_indcollation[attoff];
+		fmgr_info_cxt(get_opcode(operator), &keyinfo->eqfuncs[attoff],
+					  entry->mapcontext);
+	}
+
+	entry->idxkeys = lappend(entry->idxkeys, keyinfo);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return keyinfo;
+}
+
+/*
+ * Get the scan key info for an index of the relation, the info is cached
+ * until the relation mapping is invalidated.
+ */
+PGLogicalIndexKeyInfo *
+pglogical_relation_index_keyinfo(PGLogicalRelation *rel, Relation idxrel)
+{
+	ListCell   *lc;
+
+	foreach (lc, rel->idxkeys)
+	{
+		PGLogicalIndexKeyInfo *keyinfo = (PGLogicalIndexKeyInfo *) lfirst(lc);
+
+		if (keyinfo->indexoid == RelationGetRelid(idxrel))
+			return keyinfo;
+	}
+
+	return relcache_build_index_keyinfo(rel, idxrel);
+}
+
+/*
+ * Get the input function (or the binary receive function if 'binary' is
+ * set) for the local column at offset 'attid', along with the type I/O
+ * parameter to pass to it. The function info is cached until the relation
+ * mapping is invalidated.
+ */
+FmgrInfo *
+pglogical_relation_column_input(PGLogicalRelation *rel, int attid,
+								bool binary, Oid *typioparam)
+{
+	PGLogicalColumnIO *io = &rel->attio[attid];
+	Form_pg_attribute att = RelationGetDescr(rel->rel)->attrs[attid];
+
+	if (binary)
+	{
+		if (!io->has_recv)
+		{
+			Oid		typreceive;
+
+			getTypeBinaryInputInfo(att->atttypid, &typreceive,
+								   &io->typioparam);
+			fmgr_info_cxt(typreceive, &io->recv, rel->mapcontext);
+			io->has_recv = true;
+		}
+
+		*typioparam = io->typioparam;
+		return &io->recv;
+	}
+
+	if (!io->has_input)
+	{
+		Oid		typinput;
+
+		getTypeInputInfo(att->atttypid, &typinput, &io->typioparam);
+		fmgr_info_cxt(typinput, &io->input, rel->mapcontext);
+		io->has_input = true;
+	}
+
+	*typioparam = io->typioparam;
+	return &io->input;
+}
+
+/*
+ * Make sure the tuple buffer can hold natts attributes.
+ *
+ * The arrays are allocated as one chunk in CacheMemoryContext and only
+ * reallocated when the number of local attributes changes.
+ */
+static void
+relcache_size_tuple(PGLogicalTupleData *tuple, int natts)
+{
+	char	   *buf;
+
+	if (tuple->natts == natts && tuple->values != NULL)
+		return;
+
+	if (tuple->values != NULL)
+		pfree(tuple->values);
+
+	buf = MemoryContextAlloc(CacheMemoryContext,
+							 MAXALIGN(natts * sizeof(Datum)) +
+							 natts * 2 * sizeof(bool));
+	tuple->natts = natts;
+	tuple->values = (Datum *) buf;
+	tuple->nulls = (bool *) (buf + MAXALIGN(natts * sizeof(Datum)));
+	tuple->changed = tuple->nulls + natts;
+}
+
 static void
 relcache_free_entry(PGLogicalRelation *entry)
 {
@@ -57,6 +267,22 @@ relcache_free_entry(PGLogicalRelation *entry)
 }
 
 
+/*
+ * Find the cached info about remote relation, without mapping it to local
+ * relation.
+ *
+ * Returns NULL if the remote relation is not known.
+ */
+PGLogicalRelation *
+pglogical_relation_cache_find(uint32 remoteid)
+{
+	if (PGLogicalRelationHash == NULL)
+		return NULL;
+
+	return hash_search(PGLogicalRelationHash, (void *) &remoteid,
+					   HASH_FIND, NULL);
+}
+
 PGLogicalRelation *
 pglogical_relation_open(uint32 remoteid, LOCKMODE lockmode)
 {
@@ -80,6 +306,7 @@ pglogical_relation_open(uint32 remoteid, LOCKMODE lockmode)
 		RangeVar   *rv = makeNode(RangeVar);
 		int			i;
 		TupleDesc	desc;
+		Oid			idxoid;
 
 		rv->schemaname = (char *) entry->nspname;
 		rv->relname = (char *) entry->relname;
@@ -90,6 +317,37 @@ pglogical_relation_open(uint32 remoteid, LOCKMODE lockmode)
 			entry->attmap[i] = tupdesc_get_att_by_name(desc, entry->attnames[i]);
 
 		entry->reloid = RelationGetRelid(entry->rel);
+		entry->map_version++;
+
+		relcache_size_tuple(&entry->oldtup, desc->natts);
+		relcache_size_tuple(&entry->newtup, desc->natts);
+
+		/* Rebuild everything derived from the local relation. */
+		if (entry->mapcontext == NULL)
+			entry->mapcontext = AllocSetContextCreate(CacheMemoryContext,
+													  "pglogical relation mapping",
+													  ALLOCSET_SMALL_MINSIZE,
+													  ALLOCSET_SMALL_INITSIZE,
+													  ALLOCSET_SMALL_MAXSIZE);
+		else
+			MemoryContextReset(entry->mapcontext);
+		entry->idxkeys = NIL;
+		entry->replidx = NULL;
+		entry->attio = (PGLogicalColumnIO *)
+			MemoryContextAllocZero(entry->mapcontext,
+								   desc->natts * sizeof(PGLogicalColumnIO));
+
+		relcache_build_defaults(entry, desc);
+
+		/* Resolve the scan key of the replica identity index. */
+		idxoid = RelationGetReplicaIndex(entry->rel);
+		if (OidIsValid(idxoid))
+		{
+			Relation	idxrel = index_open(idxoid, AccessShareLock);
+
+			entry->replidx = relcache_build_index_keyinfo(entry, idxrel);
+			index_close(idxrel, AccessShareLock);
+		}
 
 		/* Cache trigger info. */
 		entry->hasTriggers = false;
@@ -139,6 +397,17 @@ pglogical_relation_cache_update(uint32 remoteid, char *schemaname,
 
 	if (found)
 		relcache_free_entry(entry);
+	else
+	{
+		entry->exec_state = NULL;
+		entry->map_version = 0;
+		entry->mapcontext = NULL;
+		entry->ndefaults = 0;
+		entry->replidx = NULL;
+		entry->idxkeys = NIL;
+		memset(&entry->oldtup, 0, sizeof(PGLogicalTupleData));
+		memset(&entry->newtup, 0, sizeof(PGLogicalTupleData));
+	}
 
 	/* Make cached copy of the data */
 	oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
@@ -154,6 +423,7 @@ pglogical_relation_cache_update(uint32 remoteid, char *schemaname,
 	/* XXX Should we validate the relation against local schema here? */
 
 	entry->reloid = InvalidOid;
+	entry->sync_version = 0;
 }
 
 void
@@ -175,6 +445,17 @@ pglogical_relation_cache_updater(PGLogicalRemoteRel *remoterel)
 
 	if (found)
 		relcache_free_entry(entry);
+	else
+	{
+		entry->exec_state = NULL;
+		entry->map_version = 0;
+		entry->mapcontext = NULL;
+		entry->ndefaults = 0;
+		entry->replidx = NULL;
+		entry->idxkeys = NIL;
+		memset(&entry->oldtup, 0, sizeof(PGLogicalTupleData));
+		memset(&entry->newtup, 0, sizeof(PGLogicalTupleData));
+	}
 
 	/* Make cached copy of the data */
 	oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
@@ -190,6 +471,7 @@ pglogical_relation_cache_updater(PGLogicalRemoteRel *remoterel)
 	/* XXX Should we validate the relation against local schema here? */
 
 	entry->reloid = InvalidOid;
+	entry->sync_version = 0;
 }
 
 void
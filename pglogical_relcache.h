@@ -13,6 +13,9 @@
 #ifndef PGLOGICAL_RELCACHE_H
 #define PGLOGICAL_RELCACHE_H
 
+#include "access/htup.h"
+#include "fmgr.h"
+
 typedef struct PGLogicalRemoteRel
 {
 	uint32		relid;
@@ -25,6 +28,48 @@ typedef struct PGLogicalRemoteRel
 	bool		hasRowFilter;
 } PGLogicalRemoteRel;
 
+/*
+ * Remote tuple converted to the local relation format.
+ *
+ * The arrays are sized to the number of attributes of the local relation and
+ * are owned by the PGLogicalRelation, so they are only valid until the next
+ * tuple for the same relation is read.
+ */
+typedef struct PGLogicalTupleData
+{
+	int		natts;
+	Datum  *values;
+	bool   *nulls;
+	bool   *changed;
+} PGLogicalTupleData;
+
+/*
+ * Resolved equality scan key for an index of the local relation.
+ */
+typedef struct PGLogicalIndexKeyInfo
+{
+	Oid			indexoid;
+	int			nkeys;
+	AttrNumber *attnums;		/* Heap attribute numbers of key columns. */
+	Oid		   *collations;
+	struct FmgrInfo *eqfuncs;	/* Equality functions of key columns. */
+} PGLogicalIndexKeyInfo;
+
+/*
+ * Input and binary receive functions of a local column, each looked up the
+ * first time it's needed.
+ */
+typedef struct PGLogicalColumnIO
+{
+	bool		has_input;
+	bool		has_recv;
+	Oid			typioparam;
+	FmgrInfo	input;
+	FmgrInfo	recv;
+} PGLogicalColumnIO;
+
+struct ApplyExecState;
+
 typedef struct PGLogicalRelation
 {
 	/* Info coming from the remote side. */
@@ -41,6 +86,51 @@ typedef struct PGLogicalRelation
 
 	/* Additional cache, only valid as long as relation mapping is. */
 	bool		hasTriggers;
+
+	/* Incremented every time the mapping is rebuilt. */
+	uint32		map_version;
+
+	/* Is the table being synchronized, valid if sync_version is current. */
+	uint32		sync_version;
+	bool		syncing;
+
+	/* Memory for the info below, reset whenever the mapping is rebuilt. */
+	MemoryContext mapcontext;
+
+	/*
+	 * Planned default expressions for local columns not present on the
+	 * remote side, ndefaults is zero if there are none. The executor state
+	 * for them is built by each user as it has to live in its EState.
+	 */
+	int			ndefaults;
+	int		   *defmap;
+	struct Expr **defexprs;
+
+	/*
+	 * Scan keys for the replica identity index (NULL if there is none) and
+	 * other indexes used for conflict detection.
+	 */
+	PGLogicalIndexKeyInfo *replidx;
+	List	   *idxkeys;
+
+	/* I/O functions of the local columns, indexed by attribute offset. */
+	PGLogicalColumnIO *attio;
+
+	/* Buffers for reading tuples, sized to the local relation. */
+	PGLogicalTupleData oldtup;
+	PGLogicalTupleData newtup;
+
+	/*
+	 * Header of the local tuple found by the last index lookup, the tuple
+	 * data itself stays in the (pinned) shared buffer.
+	 */
+	HeapTupleData localtup;
+
+	/*
+	 * Executor state cached by the apply worker, only valid within the
+	 * current local transaction.
+	 */
+	struct ApplyExecState *exec_state;
 } PGLogicalRelation;
 
 extern void pglogical_relation_cache_update(uint32 remoteid,
@@ -48,12 +138,16 @@ extern void pglogical_relation_cache_update(uint32 remoteid,
 											 int natts, char **attnames);
 extern void pglogical_relation_cache_updater(PGLogicalRemoteRel *remoterel);
 
+extern PGLogicalRelation *pglogical_relation_cache_find(uint32 remoteid);
 extern PGLogicalRelation *pglogical_relation_open(uint32 remoteid,
 												   LOCKMODE lockmode);
 extern void pglogical_relation_close(PGLogicalRelation * rel,
 									  LOCKMODE lockmode);
+extern FmgrInfo *pglogical_relation_column_input(PGLogicalRelation *rel,
+												 int attid, bool binary,
+												 Oid *typioparam);
+extern PGLogicalIndexKeyInfo *pglogical_relation_index_keyinfo(
+									PGLogicalRelation *rel, Relation idxrel);
 extern void pglogical_relation_invalidate_cb(Datum arg, Oid reloid);
 
-struct PGLogicalTupleData;
-
 #endif /* PGLOGICAL_RELCACHE_H */
@@ -51,6 +51,7 @@
 #define CATALOG_REPSET_SEQ		"replication_set_seq"
 #define CATALOG_REPSET_TABLE	"replication_set_table"
 #define CATALOG_REPSET_RELATION	"replication_set_relation"
+#define CATALOG_REPSET_TABLE_RELOID_IDX	"replication_set_table_reloid_idx"
 
 typedef struct RepSetTuple
 {
@@ -96,8 +97,23 @@ typedef struct RepSetTableTuple
 #define Anum_repset_table_att_filter	3
 #define Anum_repset_table_row_filter	4
 
+/*
+ * Preloaded rows of the replication set table catalog belonging to a single
+ * table. Entries which were invalidated are reread from the catalog on next
+ * use, tables without an entry are not part of any replication set.
+ */
+typedef struct RepSetTablePreload
+{
+	Oid			reloid;
+	bool		isvalid;
+	List	   *tuples;
+} RepSetTablePreload;
 
 static HTAB *RepSetTableHash = NULL;
+static HTAB *RepSetTablePreloadHash = NULL;
+static bool RepSetTablesPreloaded = false;
+static Oid	RepSetTableCatalogOid = InvalidOid;
+static Oid	RepSetTableReloidIdxOid = InvalidOid;
 
 /*
  * Read the replication set.
@@ -192,11 +208,45 @@ static void
 repset_relcache_invalidate_callback(Datum arg, Oid reloid)
 {
 	PGLogicalTableRepInfo *entry;
+	RepSetTablePreload *pentry;
 
 	/* Just to be sure. */
 	if (RepSetTableHash == NULL)
 		return;
 
+	/*
+	 * The catalog itself (or everything) was invalidated, so the catalog and
+	 * index oids have to be looked up again (the extension might have been
+	 * recreated or upgraded) and its contents might have changed arbitrarily,
+	 * so redo the whole preload.
+	 */
+	if (reloid == InvalidOid || reloid == RepSetTableCatalogOid)
+	{
+		RepSetTableCatalogOid = InvalidOid;
+		RepSetTableReloidIdxOid = InvalidOid;
+		RepSetTablesPreloaded = false;
+	}
+
+	/*
+	 * Membership changes are signalled through relcache invalidation of the
+	 * table, so the preloaded catalog rows of the table have to be reread as
+	 * well. Rereading them is left to get_table_replication_info(), as the
+	 * rows might be in use at this point. A table without preloaded rows
+	 * might have just been added to a replication set, so remember to read
+	 * its rows too rather than throwing away the preload of all the other
+	 * tables.
+	 */
+	if (reloid != InvalidOid && RepSetTablesPreloaded)
+	{
+		bool		found;
+
+		pentry = hash_search(RepSetTablePreloadHash, &reloid,
+							 HASH_ENTER, &found);
+		if (!found)
+			pentry->tuples = NIL;
+		pentry->isvalid = false;
+	}
+
 	if (reloid == InvalidOid)
 	{
 		HASH_SEQ_STATUS status;
@@ -244,6 +294,15 @@ repset_relcache_init(void)
 	RepSetTableHash = hash_create("pglogical repset table cache", 128,
 								  &ctl, HASH_ELEM | HASH_CONTEXT);
 
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(RepSetTablePreload);
+	ctl.hcxt = CacheMemoryContext;
+
+	RepSetTablePreloadHash = hash_create("pglogical repset table preload",
+										 128, &ctl,
+										 HASH_ELEM | HASH_CONTEXT);
+
 	/*
 	 * Watch for invalidation events fired when the relcache changes.
 	 *
@@ -351,20 +410,147 @@ get_replication_sets(Oid nodeid, List *replication_set_names, bool missing_ok)
 	return replication_sets;
 }
 
+/*
+ * Get oid of the replication set table catalog and of the index on its
+ * set_reloid column (InvalidOid if the catalog has no such index).
+ *
+ * The oids are cached until the catalog gets invalidated, see
+ * repset_relcache_invalidate_callback().
+ */
+static Oid
+get_repset_table_catalog_oid(Oid *reloid_idxoid)
+{
+	if (RepSetTableCatalogOid == InvalidOid)
+	{
+		Oid			nspoid = get_namespace_oid(EXTENSION_NAME, false);
+		Oid			reloid;
+
+		reloid = get_relname_relid(CATALOG_REPSET_TABLE, nspoid);
+		/* Backwards compat with 1.1/1.2 where the relation name was different. */
+		if (!OidIsValid(reloid))
+			reloid = get_relname_relid(CATALOG_REPSET_RELATION, nspoid);
+		if (!OidIsValid(reloid))
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_TABLE),
+					 errmsg("relation \"%s.%s\" does not exist",
+							EXTENSION_NAME, CATALOG_REPSET_TABLE)));
+
+		RepSetTableReloidIdxOid =
+			get_relname_relid(CATALOG_REPSET_TABLE_RELOID_IDX, nspoid);
+		RepSetTableCatalogOid = reloid;
+	}
+
+	*reloid_idxoid = RepSetTableReloidIdxOid;
+	return RepSetTableCatalogOid;
+}
+
+static void
+repset_preload_free_tuples(RepSetTablePreload *pentry)
+{
+	if (list_length(pentry->tuples))
+		list_free_deep(pentry->tuples);
+	pentry->tuples = NIL;
+}
+
+/*
+ * Load the replication set table catalog rows of all tables with single
+ * catalog scan.
+ *
+ * This way filling the table cache for a large number of tables (for example
+ * at the start of decoding or after full invalidation) costs one pass over
+ * the catalog instead of one lookup per table.
+ */
+static void
+repset_preload_tables(Relation repset_rel)
+{
+	HASH_SEQ_STATUS		status;
+	RepSetTablePreload *pentry;
+	SysScanDesc			scan;
+	HeapTuple			tuple;
+	MemoryContext		oldctx;
+
+	/* Throw away whatever was loaded before. */
+	hash_seq_init(&status, RepSetTablePreloadHash);
+	while ((pentry = hash_seq_search(&status)) != NULL)
+	{
+		repset_preload_free_tuples(pentry);
+		hash_search(RepSetTablePreloadHash, &pentry->reloid, HASH_REMOVE,
+					NULL);
+	}
+
+	scan = systable_beginscan(repset_rel, InvalidOid, false, NULL, 0, NULL);
+
+	oldctx = MemoryContextSwitchTo(CacheMemoryContext);
+	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		RepSetTableTuple   *t = (RepSetTableTuple *) GETSTRUCT(tuple);
+		bool				found;
+
+		pentry = hash_search(RepSetTablePreloadHash, &t->reloid,
+							 HASH_ENTER, &found);
+		if (!found)
+		{
+			pentry->isvalid = true;
+			pentry->tuples = NIL;
+		}
+		pentry->tuples = lappend(pentry->tuples, heap_copytuple(tuple));
+	}
+	MemoryContextSwitchTo(oldctx);
+
+	systable_endscan(scan);
+
+	RepSetTablesPreloaded = true;
+}
+
+/*
+ * Reread the replication set table catalog rows of a single table after
+ * it has been invalidated.
+ */
+static void
+repset_preload_table(Relation repset_rel, Oid reloid_idxoid,
+					 RepSetTablePreload *pentry)
+{
+	ScanKeyData		key[1];
+	SysScanDesc		scan;
+	HeapTuple		tuple;
+	MemoryContext	oldctx;
+
+	repset_preload_free_tuples(pentry);
+
+	ScanKeyInit(&key[0],
+				Anum_repset_table_reloid,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(pentry->reloid));
+
+	/* Catalogs created by older versions don't have the index. */
+	scan = systable_beginscan(repset_rel, reloid_idxoid,
+							  OidIsValid(reloid_idxoid), NULL, 1, key);
+
+	oldctx = MemoryContextSwitchTo(CacheMemoryContext);
+	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+		pentry->tuples = lappend(pentry->tuples, heap_copytuple(tuple));
+	MemoryContextSwitchTo(oldctx);
+
+	systable_endscan(scan);
+
+	pentry->isvalid = true;
+}
+
 PGLogicalTableRepInfo *
 get_table_replication_info(Oid nodeid, Relation table,
 						   List *subs_replication_sets)
 {
 	PGLogicalTableRepInfo *entry;
+	RepSetTablePreload *pentry;
 	bool			found;
-	RangeVar	   *rv;
 	Oid				reloid = RelationGetRelid(table);
 	Oid				repset_reloid;
+	Oid				reloid_idxoid;
 	Relation		repset_rel;
-	ScanKeyData		key[1];
-	SysScanDesc		scan;
-	HeapTuple		tuple;
 	TupleDesc		desc;
+	TupleDesc		repset_desc;
+	List		   *tuples = NIL;
+	ListCell	   *tlc;
 
 	if (RepSetTableHash == NULL)
 		repset_relcache_init();
@@ -383,6 +569,17 @@ get_table_replication_info(Oid nodeid, Relation table,
 	if (found && entry->isvalid)
 		return entry;
 
+	/*
+	 * Release the row filter executor state of the previous version of the
+	 * entry. This is not done by the invalidation callback as the state might
+	 * be in use at that point.
+	 */
+	if (found && entry->rf_estate != NULL)
+		FreeExecutorState(entry->rf_estate);
+	entry->rf_estate = NULL;
+	entry->rf_econtext = NULL;
+	entry->rf_exprstates = NIL;
+
 	/* Fill the entry */
 	entry->reloid = reloid;
 	entry->replicate_insert = false;
@@ -400,32 +597,26 @@ get_table_replication_info(Oid nodeid, Relation table,
 	 * rewrites, so if we'll want to support replicating those, we'll have
 	 * to have special handling for them.
 	 */
-	rv = makeRangeVar(EXTENSION_NAME, CATALOG_REPSET_TABLE, -1);
-	repset_reloid = RangeVarGetRelid(rv, RowExclusiveLock, true);
-	/* Backwards compat with 1.1/1.2 where the relation name was different. */
-	if (!OidIsValid(repset_reloid))
-	{
-		rv = makeRangeVar(EXTENSION_NAME, CATALOG_REPSET_RELATION, -1);
-		repset_reloid = RangeVarGetRelid(rv, RowExclusiveLock, true);
-		if (!OidIsValid(repset_reloid))
-			ereport(ERROR,
-					(errcode(ERRCODE_UNDEFINED_TABLE),
-					 errmsg("relation \"%s.%s\" does not exist",
-							rv->schemaname, rv->relname)));
-	}
-	repset_rel = heap_open(repset_reloid, NoLock);
+	repset_reloid = get_repset_table_catalog_oid(&reloid_idxoid);
+	repset_rel = heap_open(repset_reloid, AccessShareLock);
+	repset_desc = RelationGetDescr(repset_rel);
 	desc = RelationGetDescr(table);
 
-	ScanKeyInit(&key[0],
-				Anum_repset_table_reloid,
-				BTEqualStrategyNumber, F_OIDEQ,
-				ObjectIdGetDatum(reloid));
+	if (!RepSetTablesPreloaded)
+		repset_preload_tables(repset_rel);
 
-	/* TODO: use index */
-	scan = systable_beginscan(repset_rel, 0, true, NULL, 1, key);
+	pentry = hash_search(RepSetTablePreloadHash, &reloid, HASH_FIND, NULL);
 
-	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+	if (pentry != NULL)
+	{
+		if (!pentry->isvalid)
+			repset_preload_table(repset_rel, reloid_idxoid, pentry);
+		tuples = pentry->tuples;
+	}
+
+	foreach (tlc, tuples)
 	{
+		HeapTuple			tuple = (HeapTuple) lfirst(tlc);
 		RepSetTableTuple   *t = (RepSetTableTuple *) GETSTRUCT(tuple);
 		ListCell		   *lc;
 
@@ -447,7 +638,7 @@ get_table_replication_info(Oid nodeid, Relation table,
 
 				/* Uppdate replicated column map. */
 				d = heap_getattr(tuple, Anum_repset_table_att_filter,
-								 desc, &isnull);
+								 repset_desc, &isnull);
 				if (!isnull)
 				{
 					Datum	   *elems;
@@ -471,7 +662,7 @@ get_table_replication_info(Oid nodeid, Relation table,
 
 				/* Add row filter if any. */
 				d = heap_getattr(tuple, Anum_repset_table_row_filter,
-								 desc, &isnull);
+								 repset_desc, &isnull);
 				if (!isnull)
 				{
 					MemoryContext olctx = MemoryContextSwitchTo(CacheMemoryContext);
@@ -483,8 +674,7 @@ get_table_replication_info(Oid nodeid, Relation table,
 		}
 	}
 
-	systable_endscan(scan);
-	heap_close(repset_rel, RowExclusiveLock);
+	heap_close(repset_rel, AccessShareLock);
 	entry->isvalid = true;
 
 	return entry;
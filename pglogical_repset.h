@@ -46,6 +46,14 @@ typedef struct PGLogicalTableRepInfo
 										   otherwise each replicated column
 										   is a member */
 	List		   *row_filter;			/* compiled row_filter nodes */
+
+	/*
+	 * Executor state for evaluating row_filter, built by the output plugin
+	 * hooks on first use and released when the entry is rebuilt.
+	 */
+	struct EState	   *rf_estate;
+	struct ExprContext *rf_econtext;
+	List		   *rf_exprstates;
 } PGLogicalTableRepInfo;
 
 extern PGLogicalRepSet *get_replication_set(Oid setid);
@@ -31,7 +31,8 @@
 #define atooid(x)  ((Oid) strtoul((x), NULL, 10))
 
 /*
- * Fetch list of tables that are grouped in specified replication sets.
+ * Fetch list of tables that are grouped in specified replication sets,
+ * largest first.
  */
 List *
 pg_logical_get_remote_repset_tables(PGconn *conn, List *replication_sets)
@@ -63,7 +64,8 @@ pg_logical_get_remote_repset_tables(PGconn *conn, List *replication_sets)
 					 "SELECT i.relid, i.nspname, i.relname, i.att_filter,"
 					 "       i.has_row_filter"
 					 "  FROM (SELECT DISTINCT relid FROM pglogical.tables WHERE set_name = ANY(ARRAY[%s])) t,"
-					 "       LATERAL pglogical.show_repset_table_info(t.relid, ARRAY[%s]) i",
+					 "       LATERAL pglogical.show_repset_table_info(t.relid, ARRAY[%s]) i"
+					 " ORDER BY pg_catalog.pg_table_size(t.relid) DESC",
 					 repsetarr.data, repsetarr.data);
 
 	res = PQexec(conn, query.data);
@@ -13,6 +13,7 @@
 
 #include "postgres.h"
 
+#include <poll.h>
 #include <unistd.h>
 
 #include "libpq-fe.h"
@@ -24,10 +25,12 @@
 #include "access/heapam.h"
 #include "access/skey.h"
 #include "access/stratnum.h"
+#include "access/transam.h"
 #include "access/xact.h"
 
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_type.h"
 
 #include "commands/dbcommands.h"
 #include "commands/tablecmds.h"
@@ -48,9 +51,12 @@
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
+#include "utils/int8.h"
+#include "utils/lsyscache.h"
 #include "utils/pg_lsn.h"
 #include "utils/rel.h"
 #include "utils/resowner.h"
+#include "utils/syscache.h"
 
 #include "pglogical_relcache.h"
 #include "pglogical_repset.h"
@@ -68,6 +74,8 @@
 #endif
 #define PGRESTORE_BINARY "pg_restore"
 
+#define atooid(x)  ((Oid) strtoul((x), NULL, 10))
+
 #define Natts_local_sync_state	5
 #define Anum_sync_kind			1
 #define Anum_sync_subid			2
@@ -80,6 +88,41 @@ void pglogical_sync_main(Datum main_arg);
 
 static PGLogicalSyncWorker	   *MySyncWorker = NULL;
 
+/*
+ * Set once an interrupted subscription data copy can be resumed, the slot
+ * must then survive errors.
+ */
+static bool		SyncKeepSlotOnError = false;
+
+/* Number of rows a copy stream moves before letting other streams run. */
+#define COPY_STREAM_BATCH_ROWS	1000
+
+/* Upper limit on number of chunks a table is split into for copying. */
+#define MAX_COPY_CHUNKS			1024
+
+/* Table copied by the parallel copy of initial data. */
+typedef struct CopyTable
+{
+	PGLogicalRemoteRel *remoterel;
+	int			nchunks;		/* Chunks not committed yet. */
+} CopyTable;
+
+/* Part of a table which is copied in one transaction. */
+typedef struct CopyChunk
+{
+	CopyTable  *table;
+	char	   *where;			/* Key range of the chunk, NULL if the chunk
+								 * is the whole table. */
+} CopyChunk;
+
+/* One connection pair used by the parallel copy of initial data. */
+typedef struct CopyStream
+{
+	PGconn	   *origin_conn;
+	PGconn	   *target_conn;
+	CopyChunk  *chunk;			/* Chunk being copied, NULL when done. */
+} CopyStream;
+
 
 static void
 dump_structure(PGLogicalSubscription *sub, const char *destfile,
@@ -109,9 +152,11 @@ dump_structure(PGLogicalSubscription *sub, const char *destfile,
 	CommitTransactionCommand();
 
 	initStringInfo(&command);
-	appendStringInfo(&command, "%s --snapshot=\"%s\" %s -s -F c -f \"%s\" \"%s\"",
-					 pg_dump, snapshot, schema_filter.data, destfile,
-					 sub->origin_if->dsn);
+	appendStringInfo(&command, "%s", pg_dump);
+	if (snapshot != NULL)
+		appendStringInfo(&command, " --snapshot=\"%s\"", snapshot);
+	appendStringInfo(&command, " %s -s -F c -f \"%s\" \"%s\"",
+					 schema_filter.data, destfile, sub->origin_if->dsn);
 
 	res = system(command.data);
 	if (res != 0)
@@ -338,20 +383,125 @@ make_copy_attnamelist(PGLogicalRelation *rel)
 }
 
 /*
- * COPY single table over wire.
+ * Check if the type can be copied in binary format.
+ */
+static bool
+type_has_binary_io(Oid typid)
+{
+	HeapTuple	tup;
+	Form_pg_type typtup;
+	Oid			elemtype;
+	bool		result;
+
+	/* Only the built-in types are known to be same on both sides. */
+	if (typid >= FirstNormalObjectId)
+		return false;
+
+	/* Arrays are sent using the functions of their element type. */
+	elemtype = get_element_type(typid);
+	if (OidIsValid(elemtype))
+		return type_has_binary_io(elemtype);
+
+	tup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for type %u", typid);
+	typtup = (Form_pg_type) GETSTRUCT(tup);
+
+	result = OidIsValid(typtup->typsend) && OidIsValid(typtup->typreceive);
+
+	ReleaseSysCache(tup);
+
+	return result;
+}
+
+/*
+ * Check if the table can be copied in binary format.
+ *
+ * This is the case when the origin runs the same major version with the
+ * same datetime representation (the same conditions under which the
+ * replication protocol uses binary basetypes), and every copied column has
+ * the same built-in type on both sides.
+ */
+static bool
+copy_binary_compatible(PGconn *origin_conn, PGLogicalRemoteRel *remoterel,
+					   PGLogicalRelation *rel)
+{
+	TupleDesc	desc = RelationGetDescr(rel->rel);
+	const char *integer_datetimes;
+	PGresult   *res;
+	StringInfoData	query;
+	int			attnum;
+	bool		result = true;
+
+	if (PQserverVersion(origin_conn) / 100 != PG_VERSION_NUM / 100)
+		return false;
+
+	integer_datetimes = PQparameterStatus(origin_conn, "integer_datetimes");
+	if (integer_datetimes == NULL ||
+#ifdef USE_INTEGER_DATETIMES
+		strcmp(integer_datetimes, "on") != 0
+#else
+		strcmp(integer_datetimes, "off") != 0
+#endif
+		)
+		return false;
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT attname, atttypid FROM pg_catalog.pg_attribute"
+					 " WHERE attrelid = %u AND attnum > 0 AND NOT attisdropped",
+					 remoterel->relid);
+
+	res = PQexec(origin_conn, query.data);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		elog(ERROR, "could not get column types of table %s.%s: %s",
+			 remoterel->nspname, remoterel->relname,
+			 PQresultErrorMessage(res));
+
+	for (attnum = 0; attnum < desc->natts && result; attnum++)
+	{
+		Form_pg_attribute att = desc->attrs[attnum];
+		int		remoteattnum = physatt_in_attmap(rel, attnum);
+		int		i;
+
+		if (att->attisdropped || remoteattnum < 0)
+			continue;
+
+		result = false;
+		for (i = 0; i < PQntuples(res); i++)
+		{
+			if (strcmp(PQgetvalue(res, i, 0),
+					   rel->attnames[remoteattnum]) == 0)
+			{
+				result = atooid(PQgetvalue(res, i, 1)) == att->atttypid &&
+					type_has_binary_io(att->atttypid);
+				break;
+			}
+		}
+	}
+
+	PQclear(res);
+
+	return result;
+}
+
+/*
+ * Build the COPY TO query for the origin and the COPY FROM query for the
+ * target for copying single table, or only the rows matching the where
+ * clause if one is given.
+ *
+ * Binary format is used when both sides are compatible, text otherwise.
  */
 static void
-copy_table_data(PGconn *origin_conn, PGconn *target_conn,
-				PGLogicalRemoteRel *remoterel, List *replication_sets)
+make_copy_queries(PGconn *origin_conn, PGLogicalRemoteRel *remoterel,
+				  List *replication_sets, const char *where,
+				  StringInfo copyto, StringInfo copyfrom)
 {
 	PGLogicalRelation *rel;
-	PGresult   *res;
-	int			bytes;
-	char	   *copybuf;
 	List	   *attnamelist;
 	ListCell   *lc;
 	bool		first;
-	StringInfoData	query;
+	bool		binary;
 	StringInfoData	attlist;
 	MemoryContext	curctx = CurrentMemoryContext,
 					oldctx;
@@ -362,6 +512,7 @@ copy_table_data(PGconn *origin_conn, PGconn *target_conn,
 	pglogical_relation_cache_updater(remoterel);
 	rel = pglogical_relation_open(remoterel->relid, AccessShareLock);
 	attnamelist = make_copy_attnamelist(rel);
+	binary = copy_binary_compatible(origin_conn, remoterel, rel);
 
 	initStringInfo(&attlist);
 	first = true;
@@ -379,8 +530,7 @@ copy_table_data(PGconn *origin_conn, PGconn *target_conn,
 	CommitTransactionCommand();
 
 	/* Build COPY TO query. */
-	initStringInfo(&query);
-	appendStringInfoString(&query, "COPY ");
+	appendStringInfoString(copyto, "COPY ");
 
 	/*
 	 * If the table is row-filtered we need to run query over the table
@@ -415,55 +565,114 @@ copy_table_data(PGconn *origin_conn, PGconn *target_conn,
 											 strlen(repset_name)));
 		}
 
-		appendStringInfo(&query,
-						 "(SELECT %s FROM pglogical.table_data_filtered(NULL::%s, %s::regclass, ARRAY[%s])) ",
+		/*
+		 * The function is called in the select list rather than in FROM so
+		 * that the rows are streamed as the table is scanned instead of
+		 * being materialized first. OFFSET 0 makes sure it's evaluated only
+		 * once per row when expanding the columns.
+		 */
+		appendStringInfo(copyto,
+						 "(SELECT %s FROM (SELECT (r).* FROM (SELECT pglogical.table_data_filtered(NULL::%s, %s::regclass, ARRAY[%s]) AS r OFFSET 0) s) t) ",
 						 list_length(attnamelist) ? attlist.data : "*",
 						 relname.data,
 						 PQescapeLiteral(origin_conn, relname.data, relname.len),
 						 repsetarr.data);
 	}
+	else if (where != NULL)
+	{
+		/* Copy only part of the table. */
+		appendStringInfo(copyto, "(SELECT %s FROM %s.%s WHERE %s) ",
+						 list_length(attnamelist) ? attlist.data : "*",
+						 PQescapeIdentifier(origin_conn, remoterel->nspname,
+											strlen(remoterel->nspname)),
+						 PQescapeIdentifier(origin_conn, remoterel->relname,
+											strlen(remoterel->relname)),
+						 where);
+	}
 	else
 	{
 		/* Otherwise just copy the table. */
-		appendStringInfo(&query, "%s.%s ",
+		appendStringInfo(copyto, "%s.%s ",
 						 PQescapeIdentifier(origin_conn, remoterel->nspname,
 											strlen(remoterel->nspname)),
 						 PQescapeIdentifier(origin_conn, remoterel->relname,
 											strlen(remoterel->relname)));
 
 		if (list_length(attnamelist))
-			appendStringInfo(&query, "(%s) ", attlist.data);
+			appendStringInfo(copyto, "(%s) ", attlist.data);
+	}
+	appendStringInfoString(copyto, "TO stdout");
+
+	/* Build COPY FROM query. */
+	appendStringInfo(copyfrom, "COPY %s.%s FROM stdin",
+					 PQescapeIdentifier(origin_conn, remoterel->nspname,
+										strlen(remoterel->nspname)),
+					 PQescapeIdentifier(origin_conn, remoterel->relname,
+										strlen(remoterel->relname)));
+
+	if (binary)
+	{
+		appendStringInfoString(copyto, " WITH (FORMAT binary)");
+		appendStringInfoString(copyfrom, " WITH (FORMAT binary)");
 	}
-	appendStringInfoString(&query, "TO stdout");
+}
+
+/*
+ * Start COPY of single table (or of the rows matching where), the data can
+ * be read from origin_conn and written to target_conn once this returns.
+ */
+static void
+begin_table_copy(PGconn *origin_conn, PGconn *target_conn,
+				 PGLogicalRemoteRel *remoterel, List *replication_sets,
+				 const char *where)
+{
+	PGresult   *res;
+	StringInfoData	copyto;
+	StringInfoData	copyfrom;
 
+	initStringInfo(&copyto);
+	initStringInfo(&copyfrom);
+	make_copy_queries(origin_conn, remoterel, replication_sets, where,
+					  &copyto, &copyfrom);
 
 	/* Execute COPY TO. */
-	res = PQexec(origin_conn, query.data);
+	res = PQexec(origin_conn, copyto.data);
 	if (PQresultStatus(res) != PGRES_COPY_OUT)
 	{
 		ereport(ERROR,
 				(errmsg("table copy failed"),
-				 errdetail("Query '%s': %s", query.data,
+				 errdetail("Query '%s': %s", copyto.data,
 					 PQerrorMessage(origin_conn))));
 	}
-
-	/* Build COPY FROM query. */
-	resetStringInfo(&query);
-	appendStringInfo(&query, "COPY %s.%s FROM stdin",
-					 PQescapeIdentifier(origin_conn, remoterel->nspname,
-										strlen(remoterel->nspname)),
-					 PQescapeIdentifier(origin_conn, remoterel->relname,
-										strlen(remoterel->relname)));
+	PQclear(res);
 
 	/* Execute COPY FROM. */
-	res = PQexec(target_conn, query.data);
+	res = PQexec(target_conn, copyfrom.data);
 	if (PQresultStatus(res) != PGRES_COPY_IN)
 	{
 		ereport(ERROR,
 				(errmsg("table copy failed"),
-				 errdetail("Query '%s': %s", query.data,
-					 PQerrorMessage(origin_conn))));
+				 errdetail("Query '%s': %s", copyfrom.data,
+					 PQerrorMessage(target_conn))));
 	}
+	PQclear(res);
+
+	pfree(copyto.data);
+	pfree(copyfrom.data);
+}
+
+/*
+ * COPY single table over wire.
+ */
+static void
+copy_table_data(PGconn *origin_conn, PGconn *target_conn,
+				PGLogicalRemoteRel *remoterel, List *replication_sets)
+{
+	int			bytes;
+	char	   *copybuf;
+
+	begin_table_copy(origin_conn, target_conn, remoterel, replication_sets,
+					 NULL);
 
 	while ((bytes = PQgetCopyData(origin_conn, &copybuf, false)) > 0)
 	{
@@ -495,8 +704,116 @@ copy_table_data(PGconn *origin_conn, PGconn *target_conn,
 				 errdetail("destination connection reported: %s",
 					 PQerrorMessage(target_conn))));
 	}
+}
+
+/*
+ * Drop the indexes of the target table which can be rebuilt after the data
+ * are copied, and return their definitions.
+ *
+ * Indexes used by constraints, the replica identity index and indexes with
+ * properties pg_get_indexdef() does not reproduce are kept.
+ */
+static List *
+drop_deferred_indexes(PGconn *target_conn, PGLogicalRemoteRel *remoterel)
+{
+	PGresult   *res;
+	StringInfoData	relname;
+	StringInfoData	query;
+	List	   *indexdefs = NIL;
+	int			i;
+
+	initStringInfo(&relname);
+	appendStringInfo(&relname, "%s.%s",
+					 PQescapeIdentifier(target_conn, remoterel->nspname,
+										strlen(remoterel->nspname)),
+					 PQescapeIdentifier(target_conn, remoterel->relname,
+										strlen(remoterel->relname)));
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT pg_catalog.pg_get_indexdef(i.indexrelid),"
+					 "       n.nspname, c.relname"
+					 "  FROM pg_catalog.pg_index i"
+					 "  JOIN pg_catalog.pg_class c ON c.oid = i.indexrelid"
+					 "  JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace"
+					 " WHERE i.indrelid = %s::pg_catalog.regclass"
+					 "   AND i.indisvalid AND NOT i.indisclustered"
+					 "   AND NOT i.indisreplident AND c.reltablespace = 0"
+					 "   AND pg_catalog.obj_description(c.oid, 'pg_class') IS NULL"
+					 "   AND NOT EXISTS (SELECT 1 FROM pg_catalog.pg_constraint co"
+					 "                    WHERE co.conindid = i.indexrelid)",
+					 PQescapeLiteral(target_conn, relname.data, relname.len));
+
+	res = PQexec(target_conn, query.data);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		elog(ERROR, "could not get indexes of table %s: %s",
+			 relname.data, PQresultErrorMessage(res));
+
+	for (i = 0; i < PQntuples(res); i++)
+	{
+		PGresult   *dropres;
+
+		indexdefs = lappend(indexdefs, pstrdup(PQgetvalue(res, i, 0)));
+
+		resetStringInfo(&query);
+		appendStringInfo(&query, "DROP INDEX %s.%s",
+						 PQescapeIdentifier(target_conn, PQgetvalue(res, i, 1),
+											strlen(PQgetvalue(res, i, 1))),
+						 PQescapeIdentifier(target_conn, PQgetvalue(res, i, 2),
+											strlen(PQgetvalue(res, i, 2))));
+
+		dropres = PQexec(target_conn, query.data);
+		if (PQresultStatus(dropres) != PGRES_COMMAND_OK)
+			elog(ERROR, "could not drop index %s.%s: %s",
+				 PQgetvalue(res, i, 1), PQgetvalue(res, i, 2),
+				 PQresultErrorMessage(dropres));
+		PQclear(dropres);
+	}
 
 	PQclear(res);
+
+	if (list_length(indexdefs) > 0)
+		elog(DEBUG1, "deferred build of %d indexes of table %s",
+			 list_length(indexdefs), relname.data);
+
+	return indexdefs;
+}
+
+/*
+ * Recreate the indexes dropped by drop_deferred_indexes().
+ */
+static void
+create_deferred_indexes(PGconn *target_conn, List *indexdefs)
+{
+	ListCell   *lc;
+	PGresult   *res;
+
+	if (indexdefs == NIL)
+		return;
+
+	if (pglogical_sync_maintenance_work_mem > 0)
+	{
+		char	   *query;
+
+		query = psprintf("SET LOCAL maintenance_work_mem = %d",
+						 pglogical_sync_maintenance_work_mem);
+		res = PQexec(target_conn, query);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			elog(ERROR, "could not set maintenance_work_mem: %s",
+				 PQresultErrorMessage(res));
+		PQclear(res);
+	}
+
+	foreach (lc, indexdefs)
+	{
+		char	   *indexdef = lfirst(lc);
+
+		res = PQexec(target_conn, indexdef);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			elog(ERROR, "could not rebuild index \"%s\": %s",
+				 indexdef, PQresultErrorMessage(res));
+		PQclear(res);
+	}
 }
 
 /*
@@ -511,6 +828,7 @@ copy_tables_data(char *sub_name, const char *origin_dsn,
 {
 	PGconn	   *origin_conn;
 	PGconn	   *target_conn;
+	List	   *indexdefs = NIL;
 	ListCell   *lc;
 
 	/* Connect to origin node. */
@@ -530,8 +848,19 @@ copy_tables_data(char *sub_name, const char *origin_dsn,
 		remoterel = pg_logical_get_remote_repset_table(origin_conn, rv,
 													   replication_sets);
 
+		/*
+		 * Building the indexes once at the end is much faster than updating
+		 * them for every copied row. It's all done in the same transaction
+		 * so the indexes are back if anything fails.
+		 */
+		if (pglogical_sync_defer_indexes)
+			indexdefs = drop_deferred_indexes(target_conn, remoterel);
+
 		copy_table_data(origin_conn, target_conn, remoterel, replication_sets);
 
+		create_deferred_indexes(target_conn, indexdefs);
+		indexdefs = NIL;
+
 		CHECK_FOR_INTERRUPTS();
 	}
 
@@ -540,25 +869,377 @@ copy_tables_data(char *sub_name, const char *origin_dsn,
 	finish_copy_target_tx(target_conn);
 }
 
+/*
+ * Start copying the next chunk from the queue on the stream.
+ *
+ * Every chunk is copied in its own transaction on the target, so that the
+ * tables copied before an interruption don't have to be copied again, and
+ * so that chunks of one table can be copied by several streams.
+ *
+ * Returns false if there is nothing left to copy.
+ */
+static bool
+copy_stream_next_chunk(CopyStream *stream, List **queue,
+					   List *replication_sets)
+{
+	if (*queue == NIL)
+	{
+		stream->chunk = NULL;
+		return false;
+	}
+
+	stream->chunk = linitial(*queue);
+	*queue = list_delete_first(*queue);
+
+	start_copy_target_tx(stream->target_conn);
+	begin_table_copy(stream->origin_conn, stream->target_conn,
+					 stream->chunk->table->remoterel, replication_sets,
+					 stream->chunk->where);
+
+	/* Don't block on writes so that we can serve the other streams. */
+	if (PQsetnonblocking(stream->target_conn, 1) != 0)
+		elog(ERROR, "could not set target connection to nonblocking mode: %s",
+			 PQerrorMessage(stream->target_conn));
+
+	return true;
+}
+
+/*
+ * Finish the COPY of the current chunk of the stream and commit it, together
+ * with the sync status of the table if it was the last one.
+ */
+static void
+copy_stream_finish_chunk(CopyStream *stream, Oid subid)
+{
+	CopyTable  *table = stream->chunk->table;
+	PGLogicalRemoteRel *remoterel = table->remoterel;
+	PGresult   *res;
+	StringInfoData	query;
+
+	res = PQgetResult(stream->origin_conn);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errmsg("reading from origin table failed"),
+				 errdetail("source connection reported: %s",
+					 PQerrorMessage(stream->origin_conn))));
+	PQclear(res);
+	while ((res = PQgetResult(stream->origin_conn)) != NULL)
+		PQclear(res);
+
+	/* Flushes the remaining data. */
+	if (PQsetnonblocking(stream->target_conn, 0) != 0)
+		ereport(ERROR,
+				(errmsg("writing to target table failed"),
+				 errdetail("destination connection reported: %s",
+					 PQerrorMessage(stream->target_conn))));
+
+	/* Send local finish */
+	if (PQputCopyEnd(stream->target_conn, NULL) != 1)
+	{
+		ereport(ERROR,
+				(errmsg("sending copy-completion to destination connection failed"),
+				 errdetail("destination connection reported: %s",
+					 PQerrorMessage(stream->target_conn))));
+	}
+
+	res = PQgetResult(stream->target_conn);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errmsg("writing to target table failed"),
+				 errdetail("destination connection reported: %s",
+					 PQerrorMessage(stream->target_conn))));
+	PQclear(res);
+	while ((res = PQgetResult(stream->target_conn)) != NULL)
+		PQclear(res);
+
+	/*
+	 * Mark the table synchronized in the same transaction as its data (or
+	 * its last chunk, the others are committed already), so that the status
+	 * can be trusted if we are interrupted.
+	 */
+	initStringInfo(&query);
+	if (--table->nchunks == 0)
+		appendStringInfo(&query,
+						 "UPDATE %s.%s SET sync_status = '%c'"
+						 " WHERE sync_subid = %u AND sync_nspname = %s"
+						 " AND sync_relname = %s;\n",
+						 EXTENSION_NAME, CATALOG_LOCAL_SYNC_STATUS,
+						 SYNC_STATUS_READY, subid,
+						 PQescapeLiteral(stream->target_conn,
+										 remoterel->nspname,
+										 strlen(remoterel->nspname)),
+						 PQescapeLiteral(stream->target_conn,
+										 remoterel->relname,
+										 strlen(remoterel->relname)));
+	appendStringInfoString(&query, "COMMIT");
+
+	res = PQexec(stream->target_conn, query.data);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		elog(ERROR, "COMMIT on target node failed: %s",
+				PQresultErrorMessage(res));
+	PQclear(res);
+	pfree(query.data);
+
+	if (stream->chunk->where != NULL)
+		elog(DEBUG1, "finished copy of table %s.%s rows %s",
+			 remoterel->nspname, remoterel->relname, stream->chunk->where);
+	else
+		elog(DEBUG1, "finished copy of table %s.%s",
+			 remoterel->nspname, remoterel->relname);
+}
+
+/*
+ * Move data of the stream from origin to target for as long as it can be
+ * done without blocking, moving on to the next chunk when the current one
+ * is done.
+ *
+ * Fills pfd with the socket event the stream waits for, or sets *ready if
+ * the stream gave up its turn with more data already at hand.
+ *
+ * Returns false once the stream has nothing left to copy.
+ */
+static bool
+copy_stream_work(CopyStream *stream, List **queue, Oid subid,
+				 List *replication_sets, struct pollfd *pfd, bool *ready)
+{
+	bool		consumed = false;
+	int			nrows = 0;
+
+	pfd->fd = -1;
+	pfd->events = 0;
+	pfd->revents = 0;
+
+	for (;;)
+	{
+		int			rc;
+		int			bytes;
+		char	   *copybuf;
+
+		/*
+		 * Don't read more data until the target has accepted what we gave
+		 * it, so that the libpq output buffer doesn't grow without bounds.
+		 */
+		rc = PQflush(stream->target_conn);
+		if (rc < 0)
+			ereport(ERROR,
+					(errmsg("writing to target table failed"),
+					 errdetail("destination connection reported: %s",
+						 PQerrorMessage(stream->target_conn))));
+		if (rc > 0)
+		{
+			pfd->fd = PQsocket(stream->target_conn);
+			pfd->events = POLLOUT;
+			return true;
+		}
+
+		/* Let the other streams have their turn too. */
+		if (nrows++ >= COPY_STREAM_BATCH_ROWS)
+		{
+			*ready = true;
+			return true;
+		}
+
+		bytes = PQgetCopyData(stream->origin_conn, &copybuf, true);
+		if (bytes > 0)
+		{
+			if (PQputCopyData(stream->target_conn, copybuf, bytes) != 1)
+			{
+				ereport(ERROR,
+						(errmsg("writing to target table failed"),
+						 errdetail("destination connection reported: %s",
+							 PQerrorMessage(stream->target_conn))));
+			}
+			PQfreemem(copybuf);
+			consumed = false;
+		}
+		else if (bytes == 0)
+		{
+			/* Nothing buffered, read what has arrived or wait for more. */
+			if (consumed)
+			{
+				pfd->fd = PQsocket(stream->origin_conn);
+				pfd->events = POLLIN;
+				return true;
+			}
+
+			if (PQconsumeInput(stream->origin_conn) != 1)
+				ereport(ERROR,
+						(errmsg("reading from origin table failed"),
+						 errdetail("source connection reported: %s",
+							 PQerrorMessage(stream->origin_conn))));
+			consumed = true;
+		}
+		else if (bytes == -1)
+		{
+			copy_stream_finish_chunk(stream, subid);
+
+			if (!copy_stream_next_chunk(stream, queue, replication_sets))
+				return false;
+		}
+		else
+		{
+			ereport(ERROR,
+					(errmsg("reading from origin table failed"),
+					 errdetail("source connection returned %d: %s",
+						bytes, PQerrorMessage(stream->origin_conn))));
+		}
+	}
+}
+
+/*
+ * Split a big table into chunks which can be copied concurrently.
+ *
+ * The chunks are ranges of the primary key, which has to be a single integer
+ * column, so that each of them can be read using the primary key index.
+ * Returns NIL if the table should be copied in one piece.
+ */
+static List *
+plan_table_chunks(PGconn *origin_conn, CopyTable *table, int64 chunk_bytes)
+{
+	PGLogicalRemoteRel *remoterel = table->remoterel;
+	PGresult   *res;
+	StringInfoData	query;
+	char	   *keyname;
+	int64		size;
+	int64		min;
+	int64		max;
+	uint64		range;
+	uint64		step;
+	int			nchunks;
+	int			i;
+	char	   *lower = NULL;
+	List	   *chunks = NIL;
+
+	/* Get the size of the table and its primary key if it's usable. */
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT pg_catalog.pg_table_size(%u),"
+					 "       (SELECT a.attname FROM pg_catalog.pg_index i"
+					 "          JOIN pg_catalog.pg_attribute a"
+					 "            ON a.attrelid = i.indrelid AND a.attnum = i.indkey[0]"
+					 "         WHERE i.indrelid = %u AND i.indisprimary"
+					 "           AND i.indnatts = 1"
+					 "           AND a.atttypid IN ('pg_catalog.int2'::pg_catalog.regtype,"
+					 "                              'pg_catalog.int4'::pg_catalog.regtype,"
+					 "                              'pg_catalog.int8'::pg_catalog.regtype))",
+					 remoterel->relid, remoterel->relid);
+
+	res = PQexec(origin_conn, query.data);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		elog(ERROR, "could not get size of table %s.%s: %s",
+			 remoterel->nspname, remoterel->relname,
+			 PQresultErrorMessage(res));
+
+	if (PQgetisnull(res, 0, 0) || PQgetisnull(res, 0, 1) ||
+		!scanint8(PQgetvalue(res, 0, 0), true, &size) ||
+		size <= chunk_bytes)
+	{
+		PQclear(res);
+		return NIL;
+	}
+
+	keyname = PQescapeIdentifier(origin_conn, PQgetvalue(res, 0, 1),
+								 strlen(PQgetvalue(res, 0, 1)));
+	PQclear(res);
+
+	/* Get the range of the key. */
+	resetStringInfo(&query);
+	appendStringInfo(&query, "SELECT min(%s), max(%s) FROM %s.%s",
+					 keyname, keyname,
+					 PQescapeIdentifier(origin_conn, remoterel->nspname,
+										strlen(remoterel->nspname)),
+					 PQescapeIdentifier(origin_conn, remoterel->relname,
+										strlen(remoterel->relname)));
+
+	res = PQexec(origin_conn, query.data);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		elog(ERROR, "could not get key range of table %s.%s: %s",
+			 remoterel->nspname, remoterel->relname,
+			 PQresultErrorMessage(res));
+
+	if (PQgetisnull(res, 0, 0) || PQgetisnull(res, 0, 1) ||
+		!scanint8(PQgetvalue(res, 0, 0), true, &min) ||
+		!scanint8(PQgetvalue(res, 0, 1), true, &max) ||
+		min == max)
+	{
+		PQclear(res);
+		return NIL;
+	}
+	PQclear(res);
+
+	/*
+	 * Split the key range evenly, which is good enough for the usual
+	 * sequence-generated keys. The first and last chunk are open-ended so
+	 * that no row is missed.
+	 */
+	nchunks = Min(size / chunk_bytes + 1, MAX_COPY_CHUNKS);
+	range = (uint64) max - (uint64) min;
+	step = range / nchunks + 1;
+
+	for (i = 1; i < nchunks && (uint64) i * step <= range; i++)
+	{
+		CopyChunk  *chunk = palloc0(sizeof(CopyChunk));
+		char	   *upper = psprintf(INT64_FORMAT,
+									 (int64) ((uint64) min + i * step));
+
+		chunk->table = table;
+		if (lower == NULL)
+			chunk->where = psprintf("%s < %s", keyname, upper);
+		else
+			chunk->where = psprintf("%s >= %s AND %s < %s",
+									keyname, lower, keyname, upper);
+		chunks = lappend(chunks, chunk);
+
+		lower = upper;
+	}
+
+	if (lower != NULL)
+	{
+		CopyChunk  *chunk = palloc0(sizeof(CopyChunk));
+
+		chunk->table = table;
+		chunk->where = psprintf("%s >= %s", keyname, lower);
+		chunks = lappend(chunks, chunk);
+	}
+
+	elog(DEBUG1, "table %s.%s will be copied in %d chunks",
+		 remoterel->nspname, remoterel->relname, list_length(chunks));
+
+	return chunks;
+}
+
 /*
  * Copy data from origin node to target node.
  *
- * Creates new connection to origin and target.
+ * Creates pglogical.parallel_copy_streams new connections to origin and
+ * target, all origin connections use the same snapshot. The tables are
+ * handed out to the streams largest first as they become free, tables
+ * bigger than pglogical.copy_chunk_size are split into chunks which are
+ * handed out separately.
  *
  * This is basically same as the copy_tables_data, but it can't be easily
  * merged to single function because we need to get list of tables here after
  * the transaction is bound to a snapshot.
+ *
+ * The sync status of every table is recorded together with the subscription
+ * entering the data sync phase and updated as each table is committed, which
+ * lets pglogical_sync_subscription() resume an interrupted copy.
  */
-static List *
-copy_replication_sets_data(char *sub_name, const char *origin_dsn,
+static void
+copy_replication_sets_data(Oid subid, char *sub_name, const char *origin_dsn,
 						   const char *target_dsn,
 						   const char *origin_snapshot,
 						   List *replication_sets)
 {
 	PGconn	   *origin_conn;
-	PGconn	   *target_conn;
 	List	   *tables;
+	List	   *copytables = NIL;
+	List	   *queue = NIL;
 	ListCell   *lc;
+	CopyStream *streams;
+	struct pollfd *pfds;
+	int			nstreams;
+	int			i;
 
 	/* Connect to origin node. */
 	origin_conn = pglogical_connect(origin_dsn, sub_name, "copy");
@@ -568,25 +1249,137 @@ copy_replication_sets_data(char *sub_name, const char *origin_dsn,
 	tables = pg_logical_get_remote_repset_tables(origin_conn,
 												 replication_sets);
 
-	/* Connect to target node. */
-	target_conn = pglogical_connect(target_dsn, sub_name, "copy");
-	start_copy_target_tx(target_conn);
-
-	/* Copy every table. */
+	/*
+	 * Split the big tables into chunks so that several streams can copy
+	 * them. Row-filtered tables are always copied in one piece.
+	 */
 	foreach (lc, tables)
 	{
-		PGLogicalRemoteRel	*remoterel = lfirst(lc);
+		CopyTable  *table = palloc0(sizeof(CopyTable));
+		List	   *chunks = NIL;
 
-		copy_table_data(origin_conn, target_conn, remoterel, replication_sets);
+		table->remoterel = lfirst(lc);
+
+		if (pglogical_parallel_copy_streams > 1 &&
+			pglogical_copy_chunk_size > 0 &&
+			!table->remoterel->hasRowFilter)
+			chunks = plan_table_chunks(origin_conn, table,
+									   (int64) pglogical_copy_chunk_size * 1024);
+
+		if (chunks == NIL)
+		{
+			CopyChunk  *chunk = palloc0(sizeof(CopyChunk));
+
+			chunk->table = table;
+			chunks = list_make1(chunk);
+		}
+
+		table->nchunks = list_length(chunks);
+		copytables = lappend(copytables, table);
+		queue = list_concat(queue, chunks);
+	}
+
+	/* Store info about all the tables to be synchronized. */
+	StartTransactionCommand();
+	foreach (lc, copytables)
+	{
+		CopyTable			   *table = lfirst(lc);
+		PGLogicalRemoteRel	   *remoterel = table->remoterel;
+		PGLogicalSyncStatus	   *oldsync;
+		char					status;
+
+		/*
+		 * Chunks are committed one by one, remember that the table may be
+		 * only partially copied until the last one is.
+		 */
+		status = table->nchunks > 1 ? SYNC_STATUS_DATA_PARTIAL :
+			SYNC_STATUS_DATA;
+
+		oldsync = get_table_sync_status(subid, remoterel->nspname,
+										remoterel->relname, true);
+		if (oldsync)
+		{
+			set_table_sync_status(subid, remoterel->nspname,
+								  remoterel->relname, status);
+		}
+		else
+		{
+			PGLogicalSyncStatus	   newsync;
+
+			newsync.kind = SYNC_KIND_FULL;
+			newsync.subid = subid;
+			newsync.nspname = remoterel->nspname;
+			newsync.relname = remoterel->relname;
+			newsync.status = status;
+			create_local_sync_status(&newsync);
+		}
+	}
+	set_subscription_sync_status(subid, SYNC_STATUS_DATA);
+	CommitTransactionCommand();
+
+	/* From now on the copy can be resumed, keep the slot for that. */
+	SyncKeepSlotOnError = true;
+
+	nstreams = Min(pglogical_parallel_copy_streams, list_length(queue));
+	streams = (CopyStream *) palloc0(Max(nstreams, 1) * sizeof(CopyStream));
+	pfds = (struct pollfd *) palloc(Max(nstreams, 1) * sizeof(struct pollfd));
+
+	/* Connect the streams, the first one reuses the connection above. */
+	for (i = 0; i < nstreams; i++)
+	{
+		if (i == 0)
+			streams[i].origin_conn = origin_conn;
+		else
+		{
+			streams[i].origin_conn = pglogical_connect(origin_dsn, sub_name,
+													   "copy");
+			start_copy_origin_tx(streams[i].origin_conn, origin_snapshot);
+		}
+
+		streams[i].target_conn = pglogical_connect(target_dsn, sub_name,
+												   "copy");
+	}
+
+	/* Copy every chunk. */
+	for (i = 0; i < nstreams; i++)
+		copy_stream_next_chunk(&streams[i], &queue, replication_sets);
+
+	for (;;)
+	{
+		int			nfds = 0;
+		bool		ready = false;
+
+		for (i = 0; i < nstreams; i++)
+		{
+			if (streams[i].chunk == NULL)
+				continue;
+
+			if (copy_stream_work(&streams[i], &queue, subid,
+								 replication_sets, &pfds[nfds], &ready))
+				nfds++;
+		}
+
+		if (nfds == 0)
+			break;
+
+		if (poll(pfds, nfds, ready ? 0 : 1000L) < 0 && errno != EINTR)
+			ereport(ERROR,
+					(errcode_for_socket_access(),
+					 errmsg("poll() failed: %m")));
 
 		CHECK_FOR_INTERRUPTS();
 	}
 
 	/* Finish the transactions and disconnect. */
-	finish_copy_origin_tx(origin_conn);
-	finish_copy_target_tx(target_conn);
+	for (i = 0; i < nstreams; i++)
+	{
+		finish_copy_origin_tx(streams[i].origin_conn);
+		PQfinish(streams[i].target_conn);
+	}
 
-	return tables;
+	/* The first connection is used even if there was nothing to copy. */
+	if (nstreams == 0)
+		finish_copy_origin_tx(origin_conn);
 }
 
 static void
@@ -632,6 +1425,11 @@ static void
 pglogical_sync_worker_cleanup_error_cb(int code, Datum arg)
 {
 	PGLogicalSubscription  *sub = (PGLogicalSubscription *) DatumGetPointer(arg);
+
+	/* Keep the slot so that the interrupted data copy can be resumed. */
+	if (SyncKeepSlotOnError)
+		return;
+
 	pglogical_sync_worker_cleanup(sub);
 }
 
@@ -651,6 +1449,7 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 	PGLogicalSyncStatus *sync;
 	XLogRecPtr		lsn;
 	char			status;
+	bool			resumable;
 	MemoryContext	myctx,
 					oldctx;
 
@@ -665,6 +1464,13 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 	oldctx = MemoryContextSwitchTo(myctx);
 	sync = get_subscription_sync_status(sub->id, false);
 	MemoryContextSwitchTo(oldctx);
+
+	/*
+	 * Interrupted data copy can be resumed as long as the slot (and the
+	 * replication origin with it) was kept.
+	 */
+	resumable = sync->status == SYNC_STATUS_DATA &&
+		replorigin_by_name(sub->slot_name, true) != InvalidRepOriginId;
 	CommitTransactionCommand();
 
 	status = sync->status;
@@ -679,6 +1485,10 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 		case SYNC_STATUS_INIT:
 		case SYNC_STATUS_CATCHUP:
 			break;
+		case SYNC_STATUS_DATA:
+			if (resumable)
+				break;
+			/* FALLTHROUGH */
 		default:
 			elog(ERROR,
 				 "subscriber %s initialization failed during nonrecoverable step (%c), please try the setup again",
@@ -755,51 +1565,19 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 				/* Copy data. */
 				if (SyncKindData(sync->kind))
 				{
-					List	   *tables;
-					ListCell   *lc;
-
 					elog(INFO, "synchronizing data");
 
+					/*
+					 * The subscription status is set together with the
+					 * status of the individual tables.
+					 */
 					status = SYNC_STATUS_DATA;
-					StartTransactionCommand();
-					set_subscription_sync_status(sub->id, status);
-					CommitTransactionCommand();
-
-					tables = copy_replication_sets_data(sub->name,
-														sub->origin_if->dsn,
-														sub->target_if->dsn,
-														snapshot,
-														sub->replication_sets);
-
-					/* Store info about all the synchronized tables. */
-					StartTransactionCommand();
-					foreach (lc, tables)
-					{
-						RangeVar	   *rv = lfirst(lc);
-						PGLogicalSyncStatus	   *oldsync;
-
-						oldsync = get_table_sync_status(sub->id,
-														rv->schemaname,
-														rv->relname, true);
-						if (oldsync)
-						{
-							set_table_sync_status(sub->id, rv->schemaname,
-												  rv->relname,
-												  SYNC_STATUS_READY);
-						}
-						else
-						{
-							PGLogicalSyncStatus	   newsync;
-
-							newsync.kind = SYNC_KIND_FULL;
-							newsync.subid = sub->id;
-							newsync.nspname = rv->schemaname;
-							newsync.relname = rv->relname;
-							newsync.status = SYNC_STATUS_READY;
-							create_local_sync_status(&newsync);
-						}
-					}
-					CommitTransactionCommand();
+					copy_replication_sets_data(sub->id, sub->name,
+											   sub->origin_if->dsn,
+											   sub->target_if->dsn,
+											   snapshot,
+											   sub->replication_sets);
+					SyncKeepSlotOnError = false;
 				}
 
 				/* Restore post-data structure (indexes, constraints, etc). */
@@ -831,6 +1609,82 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 		CommitTransactionCommand();
 	}
 
+	if (status == SYNC_STATUS_DATA)
+	{
+		List	   *tables;
+		ListCell   *lc;
+
+		elog(INFO, "resuming synchronization of subscriber %s", sub->name);
+
+		/*
+		 * Tables which were not committed yet get synchronized individually
+		 * by the apply worker, each with its own snapshot, same as tables
+		 * added to the subscription later. Chunks of a partially copied
+		 * table can't be continued as the snapshot is gone, so the table
+		 * has to be emptied first.
+		 */
+		StartTransactionCommand();
+		oldctx = MemoryContextSwitchTo(myctx);
+		tables = get_unsynced_tables(sub->id);
+		MemoryContextSwitchTo(oldctx);
+		foreach (lc, tables)
+		{
+			RangeVar   *rv = lfirst(lc);
+			PGLogicalSyncStatus *tablesync;
+
+			tablesync = get_table_sync_status(sub->id, rv->schemaname,
+											  rv->relname, false);
+			if (tablesync->status == SYNC_STATUS_DATA_PARTIAL)
+				truncate_table(rv->schemaname, rv->relname);
+
+			set_table_sync_status(sub->id, rv->schemaname, rv->relname,
+								  SYNC_STATUS_INIT);
+		}
+		CommitTransactionCommand();
+
+		if (list_length(tables) > 0)
+			elog(INFO, "%d tables of subscriber %s will be synchronized individually",
+				 list_length(tables), sub->name);
+
+		/*
+		 * Restore post-data structure (indexes, constraints, etc). The dump
+		 * from the interrupted run is gone, so make a new one.
+		 */
+		if (SyncKindStructure(sync->kind))
+		{
+			StringInfoData	tmpfile;
+
+			elog(INFO, "synchronizing constraints");
+
+			status = SYNC_STATUS_CONSTAINTS;
+			StartTransactionCommand();
+			set_subscription_sync_status(sub->id, status);
+			CommitTransactionCommand();
+
+			oldctx = MemoryContextSwitchTo(myctx);
+			initStringInfo(&tmpfile);
+			appendStringInfo(&tmpfile, "%s/pglogical-%d.dump",
+							 pglogical_temp_directory, MyProcPid);
+			MemoryContextSwitchTo(oldctx);
+
+			PG_ENSURE_ERROR_CLEANUP(pglogical_sync_tmpfile_cleanup_cb,
+									CStringGetDatum(tmpfile.data));
+			{
+				dump_structure(sub, tmpfile.data, NULL);
+				restore_structure(sub, tmpfile.data, "post-data");
+			}
+			PG_END_ENSURE_ERROR_CLEANUP(pglogical_sync_tmpfile_cleanup_cb,
+										CStringGetDatum(tmpfile.data));
+			pglogical_sync_tmpfile_cleanup_cb(0,
+											  CStringGetDatum(tmpfile.data));
+		}
+
+		status = SYNC_STATUS_CATCHUP;
+		StartTransactionCommand();
+		set_subscription_sync_status(sub->id, status);
+		CommitTransactionCommand();
+	}
+
 	if (status == SYNC_STATUS_CATCHUP)
 	{
 		/* Nothing to do here yet. */
@@ -1054,7 +1908,8 @@ pglogical_sync_main(Datum main_arg)
 	pglogical_identify_system(streamConn, NULL, NULL, NULL, NULL);
 
 	pglogical_start_replication(streamConn, MySubscription->slot_name,
-								origin_startpos, "all", NULL, tablename);
+								origin_startpos, "all", NULL, tablename,
+								MySubscription->compression);
 
 	/* Leave it to standard apply code to do the replication. */
 	apply_work(streamConn);
@@ -122,6 +122,13 @@ pglogical_worker_register(PGLogicalWorker *worker)
 	worker_shm->crashed_at = 0;
 	worker_shm->proc = NULL;
 
+	/* Sync and helper workers start with the apply worker info as well. */
+	if (worker->worker_type != PGLOGICAL_WORKER_MANAGER)
+	{
+		pg_atomic_init_u64(&worker_shm->worker.apply.exec_state_reuses, 0);
+		pg_atomic_init_u64(&worker_shm->worker.apply.exec_state_rebuilds, 0);
+	}
+
 	LWLockRelease(PGLogicalCtx->lock);
 
 	bgw.bgw_flags =	BGWORKER_SHMEM_ACCESS |
@@ -146,6 +153,15 @@ pglogical_worker_register(PGLogicalWorker *worker)
 				 NameStr(worker->worker.sync.relname),
 				 worker->dboid, worker->worker.sync.apply.subid);
 	}
+	else if (worker->worker_type == PGLOGICAL_WORKER_APPLY_HELPER)
+	{
+		snprintf(bgw.bgw_function_name, BGW_MAXLEN,
+				 "pglogical_apply_helper_main");
+		snprintf(bgw.bgw_name, BGW_MAXLEN,
+				 "pglogical apply helper %u:%u:%d", worker->dboid,
+				 worker->worker.helper.apply.subid,
+				 worker->worker.helper.helper_id);
+	}
 	else
 	{
 		snprintf(bgw.bgw_function_name, BGW_MAXLEN,
@@ -651,6 +667,7 @@ pglogical_worker_type_name(PGLogicalWorkerType type)
 		case PGLOGICAL_WORKER_MANAGER: return "manager";
 		case PGLOGICAL_WORKER_APPLY: return "apply";
 		case PGLOGICAL_WORKER_SYNC: return "sync";
+		case PGLOGICAL_WORKER_APPLY_HELPER: return "apply helper";
 		default: Assert(false); return NULL;
 	}
 }
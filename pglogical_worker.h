@@ -13,6 +13,9 @@
 #ifndef PGLOGICAL_WORKER_H
 #define PGLOGICAL_WORKER_H
 
+#include "port/atomics.h"
+
+#include "storage/dsm.h"
 #include "storage/lock.h"
 
 #include "pglogical.h"
@@ -21,8 +24,10 @@ typedef enum {
 	PGLOGICAL_WORKER_NONE,		/* Unused slot. */
 	PGLOGICAL_WORKER_MANAGER,	/* Manager. */
 	PGLOGICAL_WORKER_APPLY,		/* Apply. */
-	PGLOGICAL_WORKER_SYNC		/* Special type of Apply that synchronizes
+	PGLOGICAL_WORKER_SYNC,		/* Special type of Apply that synchronizes
 								 * one table. */
+	PGLOGICAL_WORKER_APPLY_HELPER	/* Applies transactions dispatched by
+									 * the apply worker. */
 } PGLogicalWorkerType;
 
 typedef struct PGLogicalApplyWorker
@@ -30,6 +35,13 @@ typedef struct PGLogicalApplyWorker
 	Oid			subid;				/* Subscription id for apply worker. */
 	bool		sync_pending;		/* Is there new synchronization info pending?. */
 	XLogRecPtr	replay_stop_lsn;	/* Replay should stop here if defined. */
+
+	/*
+	 * Statistics, only written by the worker itself and read without holding
+	 * the PGLogicalCtx lock.
+	 */
+	pg_atomic_uint64	exec_state_reuses;	/* Cached executor state reused. */
+	pg_atomic_uint64	exec_state_rebuilds;	/* Executor state (re)built. */
 } PGLogicalApplyWorker;
 
 typedef struct PGLogicalSyncWorker
@@ -39,6 +51,13 @@ typedef struct PGLogicalSyncWorker
 	NameData	relname;	/* Name of the table to copy if any. */
 } PGLogicalSyncWorker;
 
+typedef struct PGLogicalApplyHelperWorker
+{
+	PGLogicalApplyWorker	apply; /* Apply worker info, must be first. */
+	dsm_handle	handle;		/* Segment shared with the apply worker. */
+	int			helper_id;	/* Index of the helper within the segment. */
+} PGLogicalApplyHelperWorker;
+
 typedef struct PGLogicalWorker {
 	PGLogicalWorkerType	worker_type;
 
@@ -59,6 +78,7 @@ typedef struct PGLogicalWorker {
 	{
 		PGLogicalApplyWorker apply;
 		PGLogicalSyncWorker sync;
+		PGLogicalApplyHelperWorker helper;
 	} worker;
 
 } PGLogicalWorker;
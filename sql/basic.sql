@@ -88,6 +88,9 @@ SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
 \c :subscriber_dsn
 SELECT id, other, data, something FROM basic_dml ORDER BY id;
 
+-- executor state is reused within the multi-row transactions
+SELECT subscription_name, exec_state_reuses > 0 AS reused, exec_state_rebuilds > 0 AS rebuilt FROM pglogical.show_subscription_stats();
+
 \c :provider_dsn
 \set VERBOSITY terse
 SELECT pglogical.replicate_ddl_command($$
@@ -0,0 +1,108 @@
+-- batched apply of inserts
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :provider_dsn
+
+SELECT pglogical.replicate_ddl_command($$
+	CREATE TABLE public.batch_plain (
+		id integer primary key,
+		data text
+	);
+	CREATE TABLE public.batch_other (
+		id integer primary key
+	);
+	CREATE TABLE public.batch_trig (
+		id integer primary key,
+		data text
+	);
+	CREATE TABLE public.batch_uniq (
+		id integer primary key,
+		u integer unique
+	);
+$$);
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'batch_plain');
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'batch_other');
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'batch_trig');
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'batch_uniq');
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+-- row triggers disable batching
+CREATE FUNCTION batch_trig_fn() RETURNS trigger AS $$
+BEGIN
+	NEW.data := upper(NEW.data);
+	RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER batch_trig_trg BEFORE INSERT ON batch_trig
+FOR EACH ROW EXECUTE PROCEDURE batch_trig_fn();
+
+ALTER TABLE batch_trig ENABLE REPLICA TRIGGER batch_trig_trg;
+
+-- the replicated row with the same key goes through conflict resolution
+INSERT INTO batch_plain VALUES (500, 'local');
+
+\c :provider_dsn
+
+INSERT INTO batch_plain SELECT g, 'data ' || g FROM generate_series(1, 1000) g;
+
+-- batches interrupted by other relations and other changes
+BEGIN;
+
+INSERT INTO batch_plain VALUES (1001, 'a'), (1002, 'b');
+
+INSERT INTO batch_other SELECT generate_series(1, 10);
+
+INSERT INTO batch_plain VALUES (1003, 'c');
+
+UPDATE batch_plain SET data = 'updated' WHERE id = 1001;
+
+INSERT INTO batch_plain VALUES (1004, 'd');
+
+DELETE FROM batch_plain WHERE id = 1002;
+
+COMMIT;
+
+INSERT INTO batch_trig SELECT g, 'data ' || g FROM generate_series(1, 5) g;
+
+INSERT INTO batch_uniq SELECT g, g FROM generate_series(1, 100) g;
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT count(*), sum(id) FROM batch_plain;
+
+SELECT * FROM batch_plain WHERE id BETWEEN 499 AND 501 OR id > 1000 ORDER BY id;
+
+SELECT count(*), sum(id) FROM batch_other;
+
+SELECT * FROM batch_trig ORDER BY id;
+
+SELECT count(*), sum(u) FROM batch_uniq;
+
+\c :provider_dsn
+
+\set VERBOSITY terse
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.batch_plain CASCADE;
+	DROP TABLE public.batch_other CASCADE;
+	DROP TABLE public.batch_trig CASCADE;
+	DROP TABLE public.batch_uniq CASCADE;
+$$);
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+DROP FUNCTION batch_trig_fn();
@@ -0,0 +1,141 @@
+-- commit coalescing of small transactions
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :provider_dsn
+
+SELECT * FROM pglogical.create_replication_set('coalesce');
+
+\c :subscriber_dsn
+
+SELECT * FROM pglogical.create_subscription(
+    subscription_name := 'test_subscription_coalesce',
+    provider_dsn := (SELECT provider_dsn FROM pglogical_regress_variables()) || ' user=super',
+	replication_sets := '{coalesce}',
+	forward_origins := '{}',
+	synchronize_structure := false,
+	synchronize_data := false,
+	coalesce_commits := 10
+);
+
+DO $$
+BEGIN
+    FOR i IN 1..300 LOOP
+        IF EXISTS (SELECT 1 FROM pglogical.show_subscription_status('test_subscription_coalesce') WHERE status = 'replicating') THEN
+            EXIT;
+        END IF;
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END;$$;
+
+SELECT sub_name, sub_coalesce_commits FROM pglogical.subscription WHERE sub_name = 'test_subscription_coalesce';
+
+SELECT subscription_name, status, replication_sets FROM pglogical.show_subscription_status('test_subscription_coalesce');
+
+\c :provider_dsn
+
+SELECT pglogical.replicate_ddl_command($$
+	CREATE TABLE public.coalesce_tbl (
+		id integer primary key,
+		data text
+	);
+	CREATE TABLE public.coalesce_sync (
+		id integer primary key
+	);
+$$, '{coalesce}');
+
+SELECT * FROM pglogical.replication_set_add_table('coalesce', 'coalesce_tbl');
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+INSERT INTO coalesce_tbl VALUES (1, 'one');
+
+INSERT INTO coalesce_tbl VALUES (2, 'two');
+
+INSERT INTO coalesce_tbl VALUES (3, 'three');
+
+UPDATE coalesce_tbl SET data = 'TWO' WHERE id = 2;
+
+DELETE FROM coalesce_tbl WHERE id = 3;
+
+INSERT INTO coalesce_tbl VALUES (4, 'four');
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT * FROM coalesce_tbl ORDER BY id;
+
+SELECT subscription_name, status, replication_sets FROM pglogical.show_subscription_status('test_subscription_coalesce');
+
+\c :provider_dsn
+
+-- table synchronization and queued DDL in the middle of a coalesced group
+
+INSERT INTO coalesce_sync VALUES (1), (2);
+
+INSERT INTO coalesce_tbl VALUES (5, 'five');
+
+SELECT * FROM pglogical.replication_set_add_table('coalesce', 'coalesce_sync', true);
+
+INSERT INTO coalesce_tbl VALUES (6, 'six');
+
+SELECT pglogical.replicate_ddl_command($$
+	ALTER TABLE public.coalesce_tbl ADD COLUMN extra integer;
+$$, '{coalesce}');
+
+INSERT INTO coalesce_tbl VALUES (7, 'seven', 7);
+
+INSERT INTO coalesce_sync VALUES (3);
+
+UPDATE coalesce_tbl SET extra = id WHERE id < 7;
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..300 LOOP
+		IF (SELECT count(1) FROM pglogical.local_sync_status WHERE sync_status = 'r' AND sync_relname IN ('coalesce_sync')) = 1 THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\c :provider_dsn
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT * FROM coalesce_tbl ORDER BY id;
+
+SELECT * FROM coalesce_sync ORDER BY id;
+
+SELECT subscription_name, status, replication_sets FROM pglogical.show_subscription_status('test_subscription_coalesce');
+
+\c :provider_dsn
+
+\set VERBOSITY terse
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.coalesce_tbl CASCADE;
+$$, '{coalesce}');
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.coalesce_sync CASCADE;
+$$, '{coalesce}');
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT pglogical.drop_subscription('test_subscription_coalesce');
+
+\c :provider_dsn
+
+SELECT * FROM pglogical.drop_replication_set('coalesce');
@@ -0,0 +1,77 @@
+-- compressed replication stream
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :provider_dsn
+
+SELECT * FROM pglogical.create_replication_set('compress');
+
+\c :subscriber_dsn
+
+SELECT * FROM pglogical.create_subscription(
+    subscription_name := 'test_subscription_compress',
+    provider_dsn := (SELECT provider_dsn FROM pglogical_regress_variables()) || ' user=super',
+	replication_sets := '{compress}',
+	forward_origins := '{}',
+	synchronize_structure := false,
+	synchronize_data := false,
+	compression := true
+);
+
+DO $$
+BEGIN
+    FOR i IN 1..300 LOOP
+        IF NOT EXISTS (SELECT 1 FROM pglogical.show_subscription_status() WHERE subscription_name = 'test_subscription_compress' AND status != 'replicating') THEN
+            EXIT;
+        END IF;
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END;$$;
+
+SELECT subscription_name, status, replication_sets FROM pglogical.show_subscription_status() WHERE subscription_name = 'test_subscription_compress';
+
+\c :provider_dsn
+
+SELECT pglogical.replicate_ddl_command($$
+	CREATE TABLE public.compress_tbl (
+		id integer primary key,
+		data text
+	);
+$$);
+
+SELECT * FROM pglogical.replication_set_add_table('compress', 'compress_tbl');
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+INSERT INTO compress_tbl SELECT g, repeat('compress me ', g) FROM generate_series(1, 100) g;
+
+UPDATE compress_tbl SET data = 'updated' WHERE id % 10 = 0;
+
+DELETE FROM compress_tbl WHERE id > 90;
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT count(*), coalesce(sum(length(data)), 0) AS length FROM compress_tbl;
+
+SELECT * FROM compress_tbl WHERE data = 'updated' ORDER BY id;
+
+\c :provider_dsn
+
+\set VERBOSITY terse
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.compress_tbl CASCADE;
+$$);
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT pglogical.drop_subscription('test_subscription_compress', true);
+
+\c :provider_dsn
+
+SELECT * FROM pglogical.drop_replication_set('compress');
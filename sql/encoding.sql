@@ -0,0 +1,130 @@
+-- change messages with and without batching and compact encoding
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :provider_dsn
+
+SELECT pglogical.replicate_ddl_command($$
+	CREATE TABLE public.encoding_tbl (
+		id integer primary key,
+		data text,
+		num numeric
+	);
+$$);
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'encoding_tbl');
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+ALTER SYSTEM SET pglogical.message_batch_size = 0;
+
+ALTER SYSTEM SET pglogical.compact_encoding = off;
+
+SELECT pg_reload_conf();
+
+SELECT pglogical.alter_subscription_disable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = false) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\c :subscriber_dsn
+
+SELECT pglogical.alter_subscription_enable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = true) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+INSERT INTO encoding_tbl SELECT g, repeat('x', g * 50), g * 1.5 FROM generate_series(1, 5) g;
+
+UPDATE encoding_tbl SET data = NULL WHERE id = 2;
+
+DELETE FROM encoding_tbl WHERE id = 3;
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT id, length(data), num FROM encoding_tbl ORDER BY id;
+
+\c :subscriber_dsn
+
+ALTER SYSTEM RESET pglogical.message_batch_size;
+
+ALTER SYSTEM RESET pglogical.compact_encoding;
+
+SELECT pg_reload_conf();
+
+SELECT pglogical.alter_subscription_disable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = false) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\c :subscriber_dsn
+
+SELECT pglogical.alter_subscription_enable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = true) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+INSERT INTO encoding_tbl SELECT g, repeat('y', g * 50), g * 1.5 FROM generate_series(300, 302) g;
+
+UPDATE encoding_tbl SET data = 'updated' WHERE id IN (1, 300);
+
+DELETE FROM encoding_tbl WHERE id = 301;
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT id, length(data), num FROM encoding_tbl ORDER BY id;
+
+\c :provider_dsn
+
+\set VERBOSITY terse
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.encoding_tbl CASCADE;
+$$);
@@ -0,0 +1,145 @@
+-- parallel apply of interleaved transactions on shared tables
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :subscriber_dsn
+
+ALTER SYSTEM SET pglogical.parallel_apply_workers = 2;
+
+SELECT pg_reload_conf();
+
+SELECT pglogical.alter_subscription_disable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = false) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\c :subscriber_dsn
+
+SELECT pglogical.alter_subscription_enable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = true) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+SELECT pglogical.replicate_ddl_command($$
+	CREATE TABLE public.parallel_apply_tbl (
+		id integer primary key,
+		data integer not null
+	);
+	CREATE TABLE public.parallel_apply_uniq (
+		id integer primary key,
+		u integer unique
+	);
+$$);
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'parallel_apply_tbl');
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'parallel_apply_uniq');
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+INSERT INTO parallel_apply_tbl SELECT g, 0 FROM generate_series(1, 10) g;
+
+INSERT INTO parallel_apply_uniq VALUES (1, 1), (2, 2);
+
+UPDATE parallel_apply_tbl SET data = data + 1 WHERE id % 2 = 0;
+
+-- the unique index on u makes every change of the table depend on the previous one
+
+UPDATE parallel_apply_uniq SET u = 3 WHERE id = 1;
+
+UPDATE parallel_apply_tbl SET data = data + 10 WHERE id % 3 = 0;
+
+UPDATE parallel_apply_uniq SET u = 1 WHERE id = 2;
+
+UPDATE parallel_apply_tbl SET data = data * 2 WHERE id <= 5;
+
+UPDATE parallel_apply_uniq SET u = 2 WHERE id = 1;
+
+DELETE FROM parallel_apply_tbl WHERE id = 7;
+
+INSERT INTO parallel_apply_tbl VALUES (7, 70);
+
+-- changes of the key depend on both the old and the new key
+
+UPDATE parallel_apply_tbl SET id = 11 WHERE id = 10;
+
+INSERT INTO parallel_apply_tbl VALUES (10, 100);
+
+UPDATE parallel_apply_tbl SET data = data + 1 WHERE id IN (1, 10, 11);
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT * FROM parallel_apply_tbl ORDER BY id;
+
+SELECT * FROM parallel_apply_uniq ORDER BY id;
+
+\c :subscriber_dsn
+
+ALTER SYSTEM RESET pglogical.parallel_apply_workers;
+
+SELECT pg_reload_conf();
+
+SELECT pglogical.alter_subscription_disable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = false) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\c :subscriber_dsn
+
+SELECT pglogical.alter_subscription_enable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = true) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\set VERBOSITY terse
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.parallel_apply_tbl CASCADE;
+$$);
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.parallel_apply_uniq CASCADE;
+$$);
@@ -0,0 +1,132 @@
+-- pipelined apply, including tables added through the queue
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :subscriber_dsn
+
+ALTER SYSTEM SET pglogical.pipelined_apply = on;
+
+SELECT pg_reload_conf();
+
+SELECT pglogical.alter_subscription_disable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = false) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\c :subscriber_dsn
+
+SELECT pglogical.alter_subscription_enable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = true) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+SELECT pglogical.replicate_ddl_command($$
+	CREATE TABLE public.pipelined_tbl (
+		id integer primary key,
+		data text
+	);
+$$);
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+INSERT INTO pipelined_tbl VALUES (1, 'copied');
+
+-- the sync request goes through the queue table, applied by the helper
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'pipelined_tbl', true);
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..300 LOOP
+		IF (SELECT count(1) FROM pglogical.local_sync_status WHERE sync_status = 'r' AND sync_relname IN ('pipelined_tbl')) = 1 THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+SELECT sync_kind, sync_nspname, sync_relname, sync_status FROM pglogical.local_sync_status WHERE sync_relname = 'pipelined_tbl';
+
+\c :provider_dsn
+
+-- changes after the sync must not be skipped
+
+INSERT INTO pipelined_tbl VALUES (2, 'replicated');
+
+UPDATE pipelined_tbl SET data = 'updated' WHERE id = 1;
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+SELECT * FROM pipelined_tbl ORDER BY id;
+
+\c :subscriber_dsn
+
+ALTER SYSTEM RESET pglogical.pipelined_apply;
+
+SELECT pg_reload_conf();
+
+SELECT pglogical.alter_subscription_disable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = false) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\c :subscriber_dsn
+
+SELECT pglogical.alter_subscription_enable('test_subscription', true);
+
+\c :provider_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..100 LOOP
+		IF (SELECT count(1) FROM pg_replication_slots WHERE active = true) THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+\set VERBOSITY terse
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.pipelined_tbl CASCADE;
+$$);
@@ -0,0 +1,175 @@
+-- initial data synchronization
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :provider_dsn
+
+SELECT * FROM pglogical.create_replication_set('sync');
+
+CREATE TABLE sync_a (
+	id integer primary key,
+	data text
+);
+
+CREATE TABLE sync_b (
+	id bigint primary key,
+	data text
+);
+
+CREATE TABLE sync_c (
+	id text primary key
+);
+
+CREATE TABLE sync_types (
+	id integer primary key,
+	n numeric,
+	b bytea,
+	ts timestamptz
+);
+
+INSERT INTO sync_a SELECT g, 'data ' || g FROM generate_series(1, 1000) g;
+
+INSERT INTO sync_b SELECT g * 1000, 'data ' || g FROM generate_series(1, 3000) g;
+
+INSERT INTO sync_c SELECT 'key ' || g FROM generate_series(1, 200) g;
+
+INSERT INTO sync_types VALUES
+	(1, 12345678901234567890.123456789, '\x00ff10', '2020-01-02 03:04:05.678+00'),
+	(2, 'NaN', '', '1999-12-31 23:59:59.999999+00'),
+	(3, -0.0001, NULL, '1970-01-01 00:00:00+00');
+
+SELECT * FROM pglogical.replication_set_add_table('sync', 'sync_a');
+
+SELECT * FROM pglogical.replication_set_add_table('sync', 'sync_b');
+
+SELECT * FROM pglogical.replication_set_add_table('sync', 'sync_c');
+
+SELECT * FROM pglogical.replication_set_add_table('sync', 'sync_types');
+
+\c :subscriber_dsn
+
+CREATE TABLE sync_a (
+	id integer primary key,
+	data text
+);
+
+CREATE TABLE sync_b (
+	id bigint primary key,
+	data text
+);
+
+CREATE TABLE sync_c (
+	id text primary key
+);
+
+CREATE TABLE sync_types (
+	id integer primary key,
+	n numeric,
+	b bytea,
+	ts timestamptz
+);
+
+ALTER SYSTEM SET pglogical.parallel_copy_streams = 2;
+
+-- split the bigger tables into several chunks
+ALTER SYSTEM SET pglogical.copy_chunk_size = '16kB';
+
+SELECT pg_reload_conf();
+
+SELECT * FROM pglogical.create_subscription(
+    subscription_name := 'test_subscription_sync',
+    provider_dsn := (SELECT provider_dsn FROM pglogical_regress_variables()) || ' user=super',
+	replication_sets := '{sync}',
+	forward_origins := '{}',
+	synchronize_structure := false,
+	synchronize_data := true
+);
+
+DO $$
+BEGIN
+    FOR i IN 1..300 LOOP
+        IF EXISTS (SELECT 1 FROM pglogical.show_subscription_status('test_subscription_sync') WHERE status = 'replicating') THEN
+            EXIT;
+        END IF;
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END;$$;
+
+SELECT subscription_name, status, replication_sets FROM pglogical.show_subscription_status('test_subscription_sync');
+
+SELECT sync_relname, sync_status FROM pglogical.local_sync_status WHERE sync_relname LIKE 'sync\_%' ORDER BY 1;
+
+SELECT count(*), sum(id) FROM sync_a;
+
+SELECT count(*), sum(id) FROM sync_b;
+
+SELECT count(*) FROM sync_c;
+
+SELECT id, n, encode(b, 'hex') AS b, extract(epoch FROM ts) AS ts FROM sync_types ORDER BY id;
+
+ALTER SYSTEM RESET pglogical.parallel_copy_streams;
+
+ALTER SYSTEM RESET pglogical.copy_chunk_size;
+
+-- deferred index build of a table added to the subscription later
+ALTER SYSTEM SET pglogical.sync_defer_indexes = on;
+
+SELECT pg_reload_conf();
+
+CREATE TABLE sync_idx (
+	id integer primary key,
+	data text
+);
+
+CREATE INDEX sync_idx_data_idx ON sync_idx (data);
+
+\c :provider_dsn
+
+CREATE TABLE sync_idx (
+	id integer primary key,
+	data text
+);
+
+INSERT INTO sync_idx SELECT g, 'data ' || g FROM generate_series(1, 500) g;
+
+SELECT * FROM pglogical.replication_set_add_table('sync', 'sync_idx', true);
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..300 LOOP
+		IF (SELECT count(1) FROM pglogical.local_sync_status WHERE sync_status = 'r' AND sync_relname IN ('sync_idx')) = 1 THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+SELECT count(*), sum(id) FROM sync_idx;
+
+SELECT c.relname, i.indisvalid FROM pg_index i JOIN pg_class c ON c.oid = i.indexrelid WHERE i.indrelid = 'sync_idx'::regclass ORDER BY 1;
+
+SET enable_seqscan = off;
+
+SELECT id FROM sync_idx WHERE data = 'data 42';
+
+RESET enable_seqscan;
+
+ALTER SYSTEM RESET pglogical.sync_defer_indexes;
+
+SELECT pg_reload_conf();
+
+SELECT pglogical.drop_subscription('test_subscription_sync');
+
+DROP TABLE sync_a, sync_b, sync_c, sync_types, sync_idx;
+
+\c :provider_dsn
+
+SELECT * FROM pglogical.drop_replication_set('sync');
+
+DROP TABLE sync_a, sync_b, sync_c, sync_types, sync_idx;
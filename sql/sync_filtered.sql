@@ -0,0 +1,57 @@
+-- streaming of row filtered table data
+
+SELECT * FROM pglogical_regress_variables()
+\gset
+
+\c :provider_dsn
+
+SELECT pglogical.replicate_ddl_command($$
+	CREATE TABLE public.sync_filtered (
+		id integer primary key,
+		data text
+	);
+$$);
+
+INSERT INTO sync_filtered SELECT g, 'row ' || g FROM generate_series(1, 20) g;
+
+SELECT * FROM pglogical.replication_set_add_table('default', 'sync_filtered', true, row_filter := $rf$id % 4 = 0$rf$);
+
+SELECT * FROM pglogical.table_data_filtered(NULL::sync_filtered, 'sync_filtered'::regclass, '{default}') ORDER BY id;
+
+SELECT (r).id, (r).data FROM (SELECT pglogical.table_data_filtered(NULL::sync_filtered, 'sync_filtered'::regclass, '{default}') AS r OFFSET 0) s ORDER BY 1;
+
+-- stop reading early, twice in the same transaction
+BEGIN;
+
+SELECT (r).id FROM (SELECT pglogical.table_data_filtered(NULL::sync_filtered, 'sync_filtered'::regclass, '{default}') AS r LIMIT 2) s;
+
+SELECT (r).id FROM (SELECT pglogical.table_data_filtered(NULL::sync_filtered, 'sync_filtered'::regclass, '{default}') AS r LIMIT 2) s;
+
+COMMIT;
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);
+
+\c :subscriber_dsn
+
+DO $$
+BEGIN
+	FOR i IN 1..300 LOOP
+		IF (SELECT count(1) FROM pglogical.local_sync_status WHERE sync_status = 'r' AND sync_relname IN ('sync_filtered')) = 1 THEN
+			RETURN;
+		END IF;
+		PERFORM pg_sleep(0.1);
+	END LOOP;
+END;
+$$;
+
+SELECT * FROM sync_filtered ORDER BY id;
+
+\c :provider_dsn
+
+\set VERBOSITY terse
+
+SELECT pglogical.replicate_ddl_command($$
+	DROP TABLE public.sync_filtered CASCADE;
+$$);
+
+SELECT pg_xlog_wait_remote_apply(pg_current_xlog_location(), 0);